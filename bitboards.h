@@ -0,0 +1,341 @@
+#ifndef BITBOARDS_H
+#define BITBOARDS_H
+
+#include "defs.h"
+#include "hashkeys.h"
+
+#define SQBB(sq)     (1ULL << (sq))
+#define POPCOUNT(bb) __builtin_popcountll(bb)
+#define LSB(bb)      __builtin_ctzll(bb)
+
+#define RANK_1_BB 0x00000000000000FFULL
+#define RANK_3_BB 0x0000000000FF0000ULL
+#define RANK_6_BB 0x0000FF0000000000ULL
+#define RANK_8_BB 0xFF00000000000000ULL
+#define FILE_A_BB 0x0101010101010101ULL
+#define FILE_H_BB 0x8080808080808080ULL
+
+#define MSB(bb)      (63 - __builtin_clzll(bb))
+
+// Files a one or two file step must not wrap onto
+#define NOT_A_BB  0xFEFEFEFEFEFEFEFEULL
+#define NOT_AB_BB 0xFCFCFCFCFCFCFCFCULL
+#define NOT_H_BB  0x7F7F7F7F7F7F7F7FULL
+#define NOT_GH_BB 0x3F3F3F3F3F3F3F3FULL
+
+// Leaper targets of the single bit b, worked out by the preprocessor
+#define KNIGHT_BB(b) ((((b) << 17) & NOT_A_BB)  | (((b) << 15) & NOT_H_BB)  \
+                    | (((b) << 10) & NOT_AB_BB) | (((b) <<  6) & NOT_GH_BB) \
+                    | (((b) >> 17) & NOT_H_BB)  | (((b) >> 15) & NOT_A_BB)  \
+                    | (((b) >> 10) & NOT_GH_BB) | (((b) >>  6) & NOT_AB_BB))
+#define KING_BB(b)   (((b) << 8) | ((b) >> 8) \
+                    | ((((b) << 1) | ((b) << 9) | ((b) >> 7)) & NOT_A_BB) \
+                    | ((((b) >> 1) | ((b) >> 9) | ((b) << 7)) & NOT_H_BB))
+#define WPAWN_BB(b)  ((((b) << 9) & NOT_A_BB) | (((b) << 7) & NOT_H_BB))
+#define BPAWN_BB(b)  ((((b) >> 7) & NOT_A_BB) | (((b) >> 9) & NOT_H_BB))
+
+#define KNIGHT_SQ(sq) KNIGHT_BB(SQBB(sq))
+#define KING_SQ(sq)   KING_BB(SQBB(sq))
+#define WPAWN_SQ(sq)  WPAWN_BB(SQBB(sq))
+#define BPAWN_SQ(sq)  BPAWN_BB(SQBB(sq))
+
+// F(0), F(1), ... F(63), to spell out a per-square table as an initializer
+#define SQ_ROW(F, r) F(8*r), F(8*r+1), F(8*r+2), F(8*r+3), F(8*r+4), F(8*r+5), F(8*r+6), F(8*r+7)
+#define SQ_TABLE(F)  SQ_ROW(F, 0), SQ_ROW(F, 1), SQ_ROW(F, 2), SQ_ROW(F, 3), \
+                     SQ_ROW(F, 4), SQ_ROW(F, 5), SQ_ROW(F, 6), SQ_ROW(F, 7)
+
+// Ray directions; the first four run towards higher squares
+enum { NORTH, EAST, NORTH_EAST, NORTH_WEST, SOUTH, WEST, SOUTH_WEST, SOUTH_EAST };
+
+#define ORTHOGONAL_DIRS (1 << NORTH | 1 << EAST | 1 << SOUTH | 1 << WEST)
+#define DIAGONAL_DIRS   (1 << NORTH_EAST | 1 << NORTH_WEST | 1 << SOUTH_WEST | 1 << SOUTH_EAST)
+
+// Per piece type, the set of directions (bit 1 << dir) it moves along
+static const int PieceDirs[7] = { 0, 0, 0, DIAGONAL_DIRS, ORTHOGONAL_DIRS, ORTHOGONAL_DIRS | DIAGONAL_DIRS, 0 };
+
+// Fancy magic entry: relevant occupancy mask, multiplier, index shift and
+// this square's slice of the shared attack table
+typedef struct {
+    U64  mask;
+    U64  magic;
+    U64 *attacks;
+    int  shift;
+} S_MAGIC;
+
+static const U64 KnightAttacks[64]   = { SQ_TABLE(KNIGHT_SQ) };
+static const U64 KingAttacks[64]     = { SQ_TABLE(KING_SQ) };
+static const U64 PawnAttacks[2][64]  = { { SQ_TABLE(WPAWN_SQ) }, { SQ_TABLE(BPAWN_SQ) } };
+
+static U64 PseudoAttacks[7][64]; // targets of each piece type (pawns excepted) on an empty board
+static U64 RayBB[8][64];        // squares from sq to the edge along each direction
+static U64 BetweenBB[64][64];   // squares strictly between two aligned squares, else 0
+static U64 LineBB[64][64];      // the whole line through two aligned squares, else 0
+
+static S_MAGIC RookMagics[64];
+static S_MAGIC BishopMagics[64];
+static U64     RookTable[0x19000];
+static U64     BishopTable[0x1480];
+
+static inline int popLSB(U64 *bb) {
+    int sq = LSB(*bb);
+    *bb &= *bb - 1;
+    return sq;
+}
+
+static inline U64 bishopAttacks(int sq, U64 occ) {
+    const S_MAGIC *m = &BishopMagics[sq];
+    return m->attacks[((occ & m->mask) * m->magic) >> m->shift];
+}
+
+static inline U64 rookAttacks(int sq, U64 occ) {
+    const S_MAGIC *m = &RookMagics[sq];
+    return m->attacks[((occ & m->mask) * m->magic) >> m->shift];
+}
+
+static inline U64 queenAttacks(int sq, U64 occ) {
+    return bishopAttacks(sq, occ) | rookAttacks(sq, occ);
+}
+
+// Attacks along dirs from sq, each ray cut after its first blocker in occ;
+// only used to fill the magic tables
+static U64 slidingAttacks(const int dirs[4], int sq, U64 occ) {
+    U64 attacks = 0;
+    for (int i = 0; i < 4; i++) {
+        U64 ray = RayBB[dirs[i]][sq];
+        U64 blockers = ray & occ;
+        if (blockers) {
+            ray ^= RayBB[dirs[i]][dirs[i] < SOUTH ? LSB(blockers) : MSB(blockers)];
+        }
+        attacks |= ray;
+    }
+    return attacks;
+}
+
+static void initMagics(const int dirs[4], S_MAGIC magics[64], U64 *table) {
+    static const U64 seeds[8] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+    static U64 occupancy[4096], reference[4096];
+    static int epoch[4096];
+    int attempt = 0;
+
+    for (int sq = 0; sq < 64; sq++) {
+        int rank = sq / 8, file = sq % 8;
+        // Edge squares never block anything further along the ray, so leave them out of the mask
+        U64 edges = ((RANK_1_BB | RANK_8_BB) & ~(RANK_1_BB << (8 * rank)))
+                  | ((FILE_A_BB | FILE_H_BB) & ~(FILE_A_BB << file));
+        S_MAGIC *m = &magics[sq];
+        m->mask    = slidingAttacks(dirs, sq, 0) & ~edges;
+        m->shift   = 64 - POPCOUNT(m->mask);
+        m->attacks = sq == 0 ? table : magics[sq - 1].attacks + (1 << (64 - magics[sq - 1].shift));
+
+        // Carry-Rippler walk over every subset of the mask
+        int size = 0;
+        U64 b = 0;
+        do {
+            occupancy[size] = b;
+            reference[size] = slidingAttacks(dirs, sq, b);
+            size++;
+            b = (b - m->mask) & m->mask;
+        } while (b);
+
+        U64 seed = seeds[rank];
+        for (int i = 0; i < size; ) {
+            m->magic = 0;
+            while (POPCOUNT((m->magic * m->mask) >> 56) < 6) {
+                m->magic = magicRand(&seed) & magicRand(&seed) & magicRand(&seed);
+            }
+            // epoch[] marks which table slots were written by this attempt
+            for (attempt++, i = 0; i < size; i++) {
+                unsigned idx = (unsigned)((occupancy[i] * m->magic) >> m->shift);
+                if (epoch[idx] < attempt) {
+                    epoch[idx] = attempt;
+                    m->attacks[idx] = reference[i];
+                } else if (m->attacks[idx] != reference[i]) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void initRays(void) {
+    static const int step[8][2] = {   // rank and file step of each direction
+        { 1, 0 }, { 0, 1 }, { 1, 1 }, { 1, -1 }, { -1, 0 }, { 0, -1 }, { -1, -1 }, { -1, 1 }
+    };
+    for (int dir = 0; dir < 8; dir++) {
+        for (int sq = 0; sq < 64; sq++) {
+            int rank = sq / 8 + step[dir][0], file = sq % 8 + step[dir][1];
+            for (; rank >= 0 && rank < 8 && file >= 0 && file < 8; rank += step[dir][0], file += step[dir][1]) {
+                RayBB[dir][sq] |= SQBB(rank * 8 + file);
+            }
+        }
+    }
+
+    // b lies on a's ray in dir exactly when a lies on b's ray the other way
+    for (int a = 0; a < 64; a++) {
+        for (int dir = 0; dir < 8; dir++) {
+            int back = (dir + 4) % 8;
+            U64 ray = RayBB[dir][a];
+            while (ray) {
+                int b = popLSB(&ray);
+                BetweenBB[a][b] = RayBB[dir][a] & RayBB[back][b];
+                LineBB[a][b]    = RayBB[dir][a] | RayBB[back][a] | SQBB(a);
+            }
+        }
+    }
+
+    for (int sq = 0; sq < 64; sq++) {
+        PseudoAttacks[KNIGHT][sq] = KnightAttacks[sq];
+        PseudoAttacks[KING][sq]   = KingAttacks[sq];
+        for (int type = BISHOP; type <= QUEEN; type++) {
+            for (int dir = 0; dir < 8; dir++) {
+                if (PieceDirs[type] & (1 << dir)) PseudoAttacks[type][sq] |= RayBB[dir][sq];
+            }
+        }
+    }
+}
+
+static void initBitboards(void) {
+    static const int rookDirs[4]   = { NORTH, EAST, SOUTH, WEST };
+    static const int bishopDirs[4] = { NORTH_EAST, NORTH_WEST, SOUTH_WEST, SOUTH_EAST };
+
+    initRays();
+    initMagics(rookDirs, RookMagics, RookTable);
+    initMagics(bishopDirs, BishopMagics, BishopTable);
+}
+
+static inline U64 occupiedBB(const S_BOARD *board) {
+    return board->colorBB[WHITE] | board->colorBB[BLACK];
+}
+
+// Board edits below keep the mailbox, the bitboards, the piece lists, the
+// king squares and the piece part of posKey in step
+static inline void addPiece(S_BOARD *board, int sq, int piece) {
+    int color = PIECE_COLOR(piece);
+    U64 bit = SQBB(sq);
+    board->pieces[sq] = piece;
+    board->posKey ^= PieceKeys[piece][sq];
+    board->pieceBB[piece] |= bit;
+    board->colorBB[color] |= bit;
+    board->pieceIndex[sq] = board->pieceCount[color];
+    board->pieceList[color][board->pieceCount[color]++] = sq;
+    if (PIECE_TYPE(piece) == KING) board->kingSq[color] = sq;
+}
+
+static inline void clearPiece(S_BOARD *board, int sq) {
+    int piece = board->pieces[sq];
+    if (piece == EMPTY) return;
+    int color = PIECE_COLOR(piece);
+    U64 bit = SQBB(sq);
+    board->pieces[sq] = EMPTY;
+    board->posKey ^= PieceKeys[piece][sq];
+    board->pieceBB[piece] &= ~bit;
+    board->colorBB[color] &= ~bit;
+    // Fill the hole with the last entry of the list
+    int last = board->pieceList[color][--board->pieceCount[color]];
+    board->pieceList[color][board->pieceIndex[sq]] = last;
+    board->pieceIndex[last] = board->pieceIndex[sq];
+}
+
+static inline void movePiece(S_BOARD *board, int from, int to) {
+    int piece = board->pieces[from];
+    int color = PIECE_COLOR(piece);
+    U64 fromTo = SQBB(from) | SQBB(to);
+    board->pieces[to] = piece;
+    board->pieces[from] = EMPTY;
+    board->posKey ^= PieceKeys[piece][from] ^ PieceKeys[piece][to];
+    board->pieceBB[piece] ^= fromTo;
+    board->colorBB[color] ^= fromTo;
+    board->pieceIndex[to] = board->pieceIndex[from];
+    board->pieceList[color][board->pieceIndex[to]] = to;
+    if (PIECE_TYPE(piece) == KING) board->kingSq[color] = to;
+}
+
+// Rebuild bitboards, piece lists, king squares and posKey from the mailbox, e.g. after initBoard
+static void rebuildBoard(S_BOARD *board) {
+    for (int piece = EMPTY; piece < PIECE_NB; piece++) {
+        board->pieceBB[piece] = 0;
+    }
+    board->colorBB[WHITE] = board->colorBB[BLACK] = 0;
+    board->pieceCount[WHITE] = board->pieceCount[BLACK] = 0;
+    for (int sq = 0; sq < SQ_NUM; sq++) {
+        if (board->pieces[sq] == EMPTY) continue;
+        addPiece(board, sq, board->pieces[sq]);
+    }
+    board->posKey = generatePosKey(board);
+}
+
+// Pieces of both colours attacking square sq, given occupancy occ
+static inline U64 attackersTo(int sq, U64 occ, const S_BOARD *board) {
+    const U64 *bb = board->pieceBB;
+    return (PawnAttacks[BLACK][sq] & bb[wP])
+         | (PawnAttacks[WHITE][sq] & bb[bP])
+         | (KnightAttacks[sq] & (bb[wN] | bb[bN]))
+         | (KingAttacks[sq] & (bb[wK] | bb[bK]))
+         | (bishopAttacks(sq, occ) & (bb[wB] | bb[bB] | bb[wQ] | bb[bQ]))
+         | (rookAttacks(sq, occ) & (bb[wR] | bb[bR] | bb[wQ] | bb[bQ]));
+}
+
+// Static exchange evaluation: the material m wins for its side once both sides
+// have recaptured on its target while that pays, least valuable piece first.
+// Attackers are re-derived after each capture, so sliders behind others join in
+static double see(const S_BOARD *board, Move m) {
+    int from = FROMSQ(m), to = TOSQ(m);
+    int side = PIECE_COLOR(board->pieces[from]);
+    int onSquare = PIECE_TYPE(board->pieces[from]);   // what the next capture takes
+    double gain[32];
+    U64 occ = occupiedBB(board) ^ SQBB(from);
+
+    if (FLAGS(m) == EP_CAPTURE) {
+        gain[0] = PieceValue[PAWN];
+        occ ^= SQBB(to - PawnPush[side]);
+    } else {
+        gain[0] = PieceValue[PIECE_TYPE(board->pieces[to])];
+    }
+    if (IS_PROMO(m)) {
+        onSquare = KNIGHT + (FLAGS(m) & 3);
+        gain[0] += PieceValue[onSquare] - PieceValue[PAWN];
+    }
+
+    int d = 0;
+    U64 attackers = attackersTo(to, occ, board) & occ;
+    while (true) {
+        side ^= 1;
+        U64 mine = attackers & board->colorBB[side];
+        if (!mine) break;
+        int type = PAWN;
+        U64 bb;
+        while (!(bb = mine & board->pieceBB[MAKE_PIECE(side, type)])) type++;
+        // The king may only take last
+        if (type == KING && (attackers & board->colorBB[side ^ 1])) break;
+        d++;
+        gain[d] = PieceValue[onSquare] - gain[d - 1];
+        onSquare = type;
+        occ ^= bb & -bb;
+        attackers = attackersTo(to, occ, board) & occ;
+    }
+    // Either side may stop recapturing when going on loses more
+    while (d > 0) {
+        d--;
+        gain[d] = -(gain[d + 1] > -gain[d] ? gain[d + 1] : -gain[d]);
+    }
+    return gain[0];
+}
+
+// Does capture m lose material? Taking a piece worth at least the taker never does
+static inline bool losingCapture(const S_BOARD *board, Move m) {
+    int victim = FLAGS(m) == EP_CAPTURE ? PAWN : PIECE_TYPE(board->pieces[TOSQ(m)]);
+    return PieceValue[victim] < PieceValue[PIECE_TYPE(board->pieces[FROMSQ(m)])] && see(board, m) < 0;
+}
+
+// Is square sq attacked by any piece of bySide
+static inline bool isSquareAttacked(int sq, int bySide, const S_BOARD *board) {
+    const U64 *bb = board->pieceBB + MAKE_PIECE(bySide, 0);
+    U64 occ = occupiedBB(board);
+    return (PawnAttacks[bySide ^ 1][sq] & bb[PAWN])
+        || (KnightAttacks[sq] & bb[KNIGHT])
+        || (KingAttacks[sq] & bb[KING])
+        || (bishopAttacks(sq, occ) & (bb[BISHOP] | bb[QUEEN]))
+        || (rookAttacks(sq, occ) & (bb[ROOK] | bb[QUEEN]));
+}
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef DEFS_H
+#define DEFS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SQ_NUM 64
+
+typedef unsigned long long U64;
+
+enum { WHITE, BLACK };
+enum { EMPTY, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING };
+
+// A piece keeps its colour in bit 3 and its type in bits 0-2
+#define MAKE_PIECE(color, type) ((color) << 3 | (type))
+#define PIECE_TYPE(p)           ((p) & 7)
+#define PIECE_COLOR(p)          ((p) >> 3)
+#define PIECE_NB                15
+
+enum {
+    wP = MAKE_PIECE(WHITE, PAWN), wN, wB, wR, wQ, wK,
+    bP = MAKE_PIECE(BLACK, PAWN), bN, bB, bR, bQ, bK
+};
+
+enum {
+    A1, B1, C1, D1, E1, F1, G1, H1,
+    A2, B2, C2, D2, E2, F2, G2, H2,
+    A3, B3, C3, D3, E3, F3, G3, H3,
+    A4, B4, C4, D4, E4, F4, G4, H4,
+    A5, B5, C5, D5, E5, F5, G5, H5,
+    A6, B6, C6, D6, E6, F6, G6, H6,
+    A7, B7, C7, D7, E7, F7, G7, H7,
+    A8, B8, C8, D8, E8, F8, G8, H8, NO_SQ
+};
+
+static const char PIECE_CHARS[] = ".PNBRQK..PNBRQK";
+
+// Per piece type: material value and whether it moves along rays
+static const double PieceValue[7] = { 0, 1, 3, 3.1, 5, 9, 0 };
+static const bool   PieceSlides[7] = { false, false, false, true, true, true, false };
+
+// Square offset of a single pawn push, per side
+static const int PawnPush[2] = { 8, -8 };
+
+// Checks that only debug builds (-DDEBUG) pay for
+#ifdef DEBUG
+#include <assert.h>
+#define ASSERT(x) assert(x)
+#else
+#define ASSERT(x)
+#endif
+
+// Forces a body into its callers, e.g. to get one copy of it per constant side
+#define FORCE_INLINE static inline __attribute__((always_inline))
+
+// Pawn advancement bonus, [0] from White's point of view and [1] from Black's
+static const int PawnEval[2][SQ_NUM] = {
+    {
+        0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0,-2,-2, 0, 0, 0,
+        1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 2, 3, 3, 2, 1, 1,
+        2, 2, 3, 4, 4, 3, 2, 2,
+        4, 4, 5, 6, 6, 5, 4, 4,
+        8, 8, 8, 8, 8, 8, 8, 8,
+        0, 0, 0, 0, 0, 0, 0, 0
+    },
+    {
+        0, 0, 0, 0, 0, 0, 0, 0,
+        8, 8, 8, 8, 8, 8, 8, 8,
+        4, 4, 5, 6, 6, 5, 4, 4,
+        2, 2, 3, 4, 4, 3, 2, 2,
+        1, 1, 2, 3, 3, 2, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1,
+        0, 0, 0,-2,-2, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0
+    }
+};
+
+// A move packed into 16 bits: from in bits 0-5, to in bits 6-11, flags in 12-15
+typedef uint16_t Move;
+
+// Bit 2 of the flags marks captures and bit 3 promotions, whose low two
+// bits then give the new piece (N, B, R, Q)
+enum {
+    QUIET, DOUBLE_PUSH, KING_CASTLE, QUEEN_CASTLE, CAPTURE, EP_CAPTURE,
+    PROMO_N = 8, PROMO_B, PROMO_R, PROMO_Q,
+    PROMO_CAPTURE_N, PROMO_CAPTURE_B, PROMO_CAPTURE_R, PROMO_CAPTURE_Q
+};
+
+#define NOMOVE 0
+#define MOVE(from, to, flags) ((Move)((from) | ((to) << 6) | ((flags) << 12)))
+#define FROMSQ(m)     ((m) & 0x3F)
+#define TOSQ(m)       (((m) >> 6) & 0x3F)
+#define FLAGS(m)      ((m) >> 12)
+#define IS_CAPTURE(m) ((FLAGS(m) & CAPTURE) != 0)
+#define IS_PROMO(m)   ((FLAGS(m) & PROMO_N) != 0)
+#define PROMOTED(m, side) MAKE_PIECE(side, KNIGHT + (FLAGS(m) & 3))
+
+#define MAX_MOVES 256
+#define MAX_DEPTH 64
+#define MAX_GAME_MOVES 1024
+#define HISTORY_MAX    (1 << 24)
+#define INF_SCORE 20000000.0
+// Score of being checkmated at the root; a mate n plies away scores n nearer zero
+#define MATE_SCORE 1000000.0
+// Scores move in steps of at least 0.01 (0.09 per pawn table point, 0.1 in material),
+// so (alpha, alpha + SCORE_EPS) holds no score and serves as a null window
+#define SCORE_EPS 0.001
+// Root window half-width around the expected score, and the width past which it is
+// dropped. A fail doubles the width, so a side is widened once (by 6) before it opens
+#define ASPIRATION_WINDOW 3.0
+#define ASPIRATION_MAX    8.0
+// Null-move cutoffs from this depth on are verified by a search without one
+#define NULL_VERIFY_DEPTH 6
+// Quiet moves from this number on may be reduced
+#define LMR_MIN_MOVES     3
+// Static-score pruning near the leaves: the deepest remaining depth each applies
+// at, and the margin in pawns per ply of depth
+#define RFP_DEPTH         3
+#define RFP_MARGIN        1.2
+#define FUTILITY_DEPTH    3
+#define FUTILITY_MARGIN   1.0
+#define RAZOR_DEPTH       2
+#define RAZOR_MARGIN      2.0
+// A hash move is tested for singularity from this depth on, against a bound this
+// many pawns per ply below its stored score
+#define SINGULAR_DEPTH    6
+#define SINGULAR_MARGIN   0.05
+// ProbCut from this depth on: captures searched this many plies shallower that
+// beat beta by the margin in pawns are taken to refute the move that led here
+#define PROBCUT_DEPTH     5
+#define PROBCUT_REDUCTION 4
+#define PROBCUT_MARGIN    1.0
+
+// Clock the engine plays on in the front ends, and what playing a move costs it
+#define ENGINE_CLOCK_MS  300000
+#define ENGINE_INC_MS    2000
+#define MOVE_OVERHEAD_MS 30
+
+// Which moves generateMoves should produce
+enum { GEN_CAPTURES = 1, GEN_QUIETS = 2, GEN_ALL = GEN_CAPTURES | GEN_QUIETS };
+
+typedef struct {
+    Move move;
+    int  score;   // ordering key, higher is searched first
+} S_MOVE;
+
+typedef struct {
+    S_MOVE moves[MAX_MOVES];
+    int    count;
+} S_MOVELIST;
+
+enum {
+    STAGE_HASH, STAGE_GEN_CAPTURES, STAGE_CAPTURES,
+    STAGE_KILLERS, STAGE_GEN_QUIETS, STAGE_QUIETS, STAGE_DONE
+};
+
+// Hands out the moves of one node a stage at a time, see nextMove
+typedef struct {
+    S_MOVELIST list;
+    Move hashMove;
+    Move killers[2];
+    const int (*history)[SQ_NUM];     // history of the side to move, by from and to
+    int  stage;
+    int  index;
+} S_MOVEPICKER;
+
+// Wings a side can no longer castle on; wCastle and bCastle hold these bits,
+// so 0 keeps both rights
+enum { KING_SIDE = 1, QUEEN_SIDE = 2 };
+
+// Limits, bookkeeping and move-ordering state of one searchPosition call; times
+// are getTimeMs values, looked at only when timed
+typedef struct {
+    long long startTime;
+    long long softStop;   // no new iteration starts after this
+    long long hardStop;   // the search is abandoned here, once depth 1 has finished
+    int depth;            // deepest iteration to run
+    int completed;        // deepest iteration finished so far
+    bool timed;           // false when only depth limits the search
+    U64 nodes;
+    bool stopped;
+    int history[2][SQ_NUM][SQ_NUM];   // butterfly table: cutoff credit per side, from and to
+} S_SEARCHINFO;
+
+// What takeMove needs back that the move itself does not tell
+typedef struct {
+    U64 posKey;
+    uint16_t fiftyMove;
+    Move move;
+    uint8_t captured;
+    uint8_t enPas;
+    uint8_t wCastle;
+    uint8_t bCastle;
+} S_UNDO;
+
+// Byte-sized squares on a 64-square mailbox; the sets come first so nothing needs padding
+typedef struct {
+    U64 pieceBB[PIECE_NB];            // one set per piece (a1 = bit 0)
+    U64 colorBB[2];                   // all white / all black pieces
+    U64 posKey;                       // Zobrist key of the position, see hashkeys.h
+    Move bestMove;
+    Move searchKillers[2][MAX_DEPTH]; // quiet moves that last caused a cutoff at each ply
+    Move searchExcluded[MAX_DEPTH];   // move left out at each ply by a singular extension test
+    uint16_t fiftyMove;               // plies since the last capture or pawn move
+    uint8_t pieces[SQ_NUM];
+    uint8_t pieceList[2][16];         // squares holding each side's pieces, in no order
+    uint8_t pieceIndex[SQ_NUM];       // slot of the piece on sq in its side's pieceList
+    uint8_t pieceCount[2];
+    uint8_t kingSq[2];
+    uint8_t side;
+    uint8_t enPas;
+    uint8_t wCastle;
+    uint8_t bCastle;
+    uint8_t ply;                      // depth below the search root
+    uint16_t hisPly;                  // moves made on this board, the top of history
+    S_UNDO history[MAX_GAME_MOVES];   // 16 KB, kept last so the fields above share cache lines
+} S_BOARD;
+
+#endif
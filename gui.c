@@ -3,34 +3,31 @@
 #include <SDL2_image/SDL_image.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <time.h>
 #include "defs.h"
+#include "bitboards.h"
+#include "ttable.h"
 
 #define WINDOW_SIZE    800
 #define SQUARE_SIZE    (WINDOW_SIZE/8)
 
 static SDL_Window   *window     = NULL;
 static SDL_Renderer *renderer   = NULL;
-static SDL_Texture  *textures[13] = { NULL };
+static SDL_Texture  *textures[PIECE_NB] = { NULL };
 static S_BOARD       board;
 static int           selectedFrom = NO_SQ;
-static Move          selMoves[256];
-static int           selCount = 0;
+static S_MOVELIST    selMoves;     // legal moves of the selected piece
+static long long     engineClock = ENGINE_CLOCK_MS;
 
 
-void initBoard(int (*pieces)[BOARD_SQ_NUM]) {
-    // Initialize every position to off board initially
-    for (int sq = 0; sq < BOARD_SQ_NUM; sq++) {
-        (*pieces)[sq] = OFFBOARD;
+void initBoard(uint8_t (*pieces)[SQ_NUM]) {
+    // Initialize every square to empty
+    for (int sq = 0; sq < SQ_NUM; sq++) {
+        (*pieces)[sq] = EMPTY;
     }
 
-    // 2) now fill in only the “real” 8×8 squares:
-    for (int rank = 0; rank < 8; rank++) {
-        for (int file = 0; file < 8; file++) {
-            int sq120 = (rank+2)*10 + (file+1);  // maps (0,0)=>21 up to (7,7)=>98
-            (*pieces)[sq120] = EMPTY;         // or your starting piece
-        }
-    }
     //initialize white pieces
     (*pieces)[A1] = wR;
     (*pieces)[B1] = wN;
@@ -70,196 +67,134 @@ void initBoard(int (*pieces)[BOARD_SQ_NUM]) {
     (*pieces)[H7] = bP;
 }
 
-void printBoard(int pieces[BOARD_SQ_NUM]) {
+void printBoard(const uint8_t pieces[SQ_NUM]) {
     printf("   ");
     for (int i = 0; i < 8; i++) {
         printf("%c  ", 97+i);
     }
     printf("\n");
     for (int i = A1; i <= H8; i++) {
-        if (i % 10 == 1) {
-            printf("%d  ", (i/10)-1);
-        }
-        if ((i%10 < 1) || (i%10 > 8)) {
-            continue;
-        }
-        char color;
-        if (pieces[i] < 1) {
-            color = '_';
-        } else if (pieces[i] < 7) {
-            color = 'w';
-        } else {
-            color = 'b';
+        if (i % 8 == 0) {
+            printf("%d  ", (i/8)+1);
         }
+        char color = pieces[i] == EMPTY ? '_' : "wb"[PIECE_COLOR(pieces[i])];
         printf("%c%c ",color,PIECE_CHARS[pieces[i]]);
-        if (i % 10 == 8) {
+        if (i % 8 == 7) {
             printf("\n");
         }
     }
 }
 
 int squareToValue(char file, char rank) {
-    return (rank - 49)*10 + (file - 97) + A1;
+    return (rank - 49)*8 + (file - 97) + A1;
 }
 
-Move parseMove(char SAN[99], S_BOARD board) {
-    // Initialize all move variables to default values
-    Move m;
-    m.from = NO_SQ;
-    m.to = NO_SQ;
-    m.promotion = EMPTY;
-    m.is_castle_kingside = false;
-    m.is_castle_queenside = false;
+Move parseMove(char SAN[99], const S_BOARD *board) {
+    int back = board->side == WHITE ? 0 : A8;
 
     // Check if kingside castle
     if (strcmp(SAN, "O-O") == 0) {
-        m.is_castle_kingside = true;
-        return m;
+        return MOVE(E1 + back, G1 + back, KING_CASTLE);
     }
 
     // Check if queenside castle    
     if (strcmp(SAN, "O-O-O") == 0) {
-        m.is_castle_queenside = true;
-        return m;
-    }
-
-    // Check for promotion move
-    if (strstr(SAN, "=") != NULL) {
-        m.from = squareToValue(SAN[0], SAN[1]);
-        m.to = squareToValue(SAN[2], SAN[3]);
-        
-        for (int i = 0; i < 13; i++) {
-            if (SAN[5] == PIECE_CHARS[i]) {
-                if (board.side == BLACK) {
-                    m.promotion = i+6;
-                } else {
-                    m.promotion = i;
-                }
-                break;
-            }
-        }
-        return m;
+        return MOVE(E1 + back, C1 + back, QUEEN_CASTLE);
     }
 
+    int from, to;
     if (SAN[0] < 97) {
-        m.from = squareToValue(SAN[1], SAN[2]);
-        m.to = squareToValue(SAN[3], SAN[4]);
+        from = squareToValue(SAN[1], SAN[2]);
+        to = squareToValue(SAN[3], SAN[4]);
     } else {
-        m.from = squareToValue(SAN[0], SAN[1]);
-        m.to = squareToValue(SAN[2], SAN[3]);
-    }
-    
-    return m;
-    
-}
-
-bool isKingInCheck(S_BOARD board) {
-
-    int king_square = 0;
-    for (int i = 0; i < BOARD_SQ_NUM; i++) {
-        if (board.side == WHITE && board.pieces[i] == wK) {
-            king_square = i;
-        } else if (board.side == BLACK && board.pieces[i] == bK) {
-            king_square = i;
-        }
-    }
-
-    int start_square = king_square;
-    
-    // Knight Checks
-    for (int i = 0; i < 8; i++) {
-        start_square += KNIGHT_DIRS[i];
-        if ((board.pieces[start_square] == wN && board.side == BLACK) || (board.pieces[start_square] == bN && board.side == WHITE)) {
-            return true;
-        }
-        start_square = king_square;
-    }
-
-    // Pawn Checks (Corrected directions)
-    if (board.side == WHITE) {
-        if (board.pieces[start_square + 11] == bP || board.pieces[start_square + 9] == bP) {
-            return true;
-        }
-    } else {
-        if (board.pieces[start_square - 11] == wP || board.pieces[start_square - 9] == wP) {
-            return true;
-        }
-    }
-
-    // Bishop Checks
-    for (int i = 0; i < 4; i++) {
-        start_square += BISHOP_DIRS[i];
-        while (board.pieces[start_square] != OFFBOARD) {
-            if ((board.pieces[start_square] > 0 && board.pieces[start_square] < 7 && board.side == WHITE) || (board.pieces[start_square] >= 7 && board.side == BLACK)) {
-                break;
-            }
-            if (((board.pieces[start_square] == wB || board.pieces[start_square] == wQ) && board.side == BLACK) || ((board.pieces[start_square] == bB || board.pieces[start_square] == bQ) && board.side == WHITE)) {
-                return true;
-            }
-            if (board.pieces[start_square] != EMPTY) {
-                break;
+        from = squareToValue(SAN[0], SAN[1]);
+        to = squareToValue(SAN[2], SAN[3]);
+    }
+    // Only 6 bits per square fit in a move, so anything else is rejected here
+    if (from < 0 || from >= SQ_NUM || to < 0 || to >= SQ_NUM) {
+        return NOMOVE;
+    }
+
+    int flags = board->pieces[to] != EMPTY ? CAPTURE : QUIET;
+    int piece = board->pieces[from];
+    if (PIECE_TYPE(piece) == PAWN) {
+        if (to - from == 16 || to - from == -16) {
+            flags = DOUBLE_PUSH;
+        } else if ((to - from) % 8 != 0 && board->pieces[to] == EMPTY) {
+            flags = EP_CAPTURE;
+        } else if (to / 8 == 0 || to / 8 == 7) {
+            // Check for promotion move, a queen unless "=N", "=B" or "=R" says otherwise
+            flags |= PROMO_Q;
+            if (strstr(SAN, "=") != NULL) {
+                switch (SAN[5]) {
+                    case 'N': flags = (flags & CAPTURE) | PROMO_N; break;
+                    case 'B': flags = (flags & CAPTURE) | PROMO_B; break;
+                    case 'R': flags = (flags & CAPTURE) | PROMO_R; break;
+                    case 'Q': break;
+                    default: return NOMOVE;
+                }
             }
-            start_square += BISHOP_DIRS[i];
         }
-        start_square = king_square;
     }
+    return MOVE(from, to, flags);
+}
 
-    // Rook Checks
-    for (int i = 0; i < 4; i++) {
-        start_square += ROOK_DIRS[i];
-        while (board.pieces[start_square] != OFFBOARD) {
-            if ((board.pieces[start_square] > 0 && board.pieces[start_square] < 7 && board.side == WHITE) || (board.pieces[start_square] >= 7 && board.side == BLACK)) {
-                break;
-            }
-            if (((board.pieces[start_square] == wR || board.pieces[start_square] == wQ) && board.side == BLACK) || ((board.pieces[start_square] == bR || board.pieces[start_square] == bQ) && board.side == WHITE)) {
-                return true;
-            }
-            if (board.pieces[start_square] != EMPTY) {
-                break;
-            }
-            start_square += ROOK_DIRS[i];
-        }
-        start_square = king_square;
-    }
+bool isKingInCheck(const S_BOARD *board) {
+    return isSquareAttacked(board->kingSq[board->side], board->side ^ 1, board);
+}
 
-    return false;
+// Would m leave the mover's own king attacked? Answered on occupancy sets
+// with the move applied, so the board itself is never copied or edited
+static bool leavesKingInCheck(Move m, const S_BOARD *board) {
+    int them = board->side ^ 1;
+    int kingSq = board->kingSq[board->side];
+    U64 captured = SQBB(TOSQ(m));
+    U64 occ = (occupiedBB(board) ^ SQBB(FROMSQ(m))) | SQBB(TOSQ(m));
+
+    if (FROMSQ(m) == kingSq) {
+        kingSq = TOSQ(m);
+    }
+    // A pawn stepping diagonally onto an empty square takes the pawn beside it
+    int piece = board->pieces[FROMSQ(m)];
+    if (PIECE_TYPE(piece) == PAWN && board->pieces[TOSQ(m)] == EMPTY && (TOSQ(m) - FROMSQ(m)) % 8 != 0) {
+        int ep_pawn_sq = TOSQ(m) - PawnPush[board->side];
+        captured |= SQBB(ep_pawn_sq);
+        occ ^= SQBB(ep_pawn_sq);
+    }
+    return (attackersTo(kingSq, occ, board) & board->colorBB[them] & ~captured) != 0;
 }
 
-bool checkLegalPawn(Move m, S_BOARD board) {
-    int color_mult = board.side == WHITE ? 1 : -1;
-    bool enPassant = false;
-    int move_diff = m.to - m.from;
+// Pawn rules for a constant side; checkLegalPawn picks the copy once per call
+FORCE_INLINE bool checkLegalPawnFor(Move m, const S_BOARD *board, const int side) {
+    int color_mult = side == WHITE ? 1 : -1;
+    int move_diff = TOSQ(m) - FROMSQ(m);
 
     // Regular pawn moves
-    if (move_diff == 10 * color_mult) {  // Single push
-        if (board.pieces[m.to] != EMPTY) return false;
+    if (move_diff == 8 * color_mult) {  // Single push
+        if (board->pieces[TOSQ(m)] != EMPTY) return false;
     } 
-    else if (move_diff == 20 * color_mult) {  // Double push
-        int middle_sq = m.from + 10 * color_mult;
-        if ((board.side == WHITE && (m.from < A2 || m.from > H2)) || 
-            (board.side == BLACK && (m.from < A7 || m.from > H7)) ||
-            board.pieces[m.to] != EMPTY || 
-            board.pieces[middle_sq] != EMPTY) {
+    else if (move_diff == 16 * color_mult) {  // Double push
+        int middle_sq = FROMSQ(m) + 8 * color_mult;
+        if ((side == WHITE && (FROMSQ(m) < A2 || FROMSQ(m) > H2)) || 
+            (side == BLACK && (FROMSQ(m) < A7 || FROMSQ(m) > H7)) ||
+            board->pieces[TOSQ(m)] != EMPTY || 
+            board->pieces[middle_sq] != EMPTY) {
             return false;
         }
     }
     // Capture moves (including en passant)
-    else if (move_diff == 9 * color_mult || move_diff == 11 * color_mult) {
+    else if (PawnAttacks[side][FROMSQ(m)] & SQBB(TOSQ(m))) {
         // Regular capture check
-        if (board.pieces[m.to] == EMPTY) {
+        if (board->pieces[TOSQ(m)] == EMPTY) {
             // En passant validation
-            if (m.to != board.enPas) return false;
-            int ep_pawn_sq = board.side == WHITE ? m.to - 10 : m.to + 10;
-            if (board.pieces[ep_pawn_sq] != (board.side == WHITE ? bP : wP)) {
+            if (TOSQ(m) != board->enPas) return false;
+            int ep_pawn_sq = side == WHITE ? TOSQ(m) - 8 : TOSQ(m) + 8;
+            if (board->pieces[ep_pawn_sq] != MAKE_PIECE(side ^ 1, PAWN)) {
                 return false;
             }
-            enPassant = true;
         } 
         else {  // Regular capture
-            bool valid_capture = (board.side == WHITE) ? 
-                (board.pieces[m.to] >= bP) : 
-                (board.pieces[m.to] <= wK);
-            if (!valid_capture) return false;
+            if (PIECE_COLOR(board->pieces[TOSQ(m)]) == side) return false;
         }
     } 
     else {
@@ -267,723 +202,920 @@ bool checkLegalPawn(Move m, S_BOARD board) {
     }
 
     // Simulate move and check for exposed king
-    int captured_piece = board.pieces[m.to];
-    int original_ep = board.enPas;
-    int ep_pawn_sq = board.side == WHITE ? m.to - 10 : m.to + 10; // Added for enPassant
-    
-    if (enPassant) {
-        board.pieces[ep_pawn_sq] = EMPTY; // Corrected: remove the pawn at ep_pawn_sq
-    }
-    board.pieces[m.to] = board.pieces[m.from];
-    board.pieces[m.from] = EMPTY;
-
-    bool in_check = isKingInCheck(board);
-
-    // Restore board state
-    board.pieces[m.from] = board.pieces[m.to];
-    board.pieces[m.to] = captured_piece;
-    if (enPassant) {
-        board.pieces[ep_pawn_sq] = (board.side == WHITE ? bP : wP); // Restore the pawn
-    }
-    board.enPas = original_ep;
-
-    return !in_check;
+    return !leavesKingInCheck(m, board);
 }
 
-static bool isPathClear(int from, int to, int dir, int pieces[BOARD_SQ_NUM]) {
-    int sq = from + dir;
-    while (sq != to) {
-        if (pieces[sq] != EMPTY) return false;
-        sq += dir;
-    }
-    return true;
+bool checkLegalPawn(Move m, const S_BOARD *board) {
+    return board->side == WHITE ? checkLegalPawnFor(m, board, WHITE) : checkLegalPawnFor(m, board, BLACK);
 }
 
-bool checkLegalBishop(Move m, S_BOARD board) {
-    int delta = m.to - m.from, dir = 0;
-    for (int i = 0; i < 4; i++) {
-        if (delta % BISHOP_DIRS[i] == 0 && delta / BISHOP_DIRS[i] > 0) {
-            dir = BISHOP_DIRS[i];
-            break;
-        }
-    }
-    if (!dir) return false;
-
-    // make sure all squares _between_ from and to are empty
-    if (!isPathClear(m.from, m.to, dir, board.pieces)) return false;
+// Knights, sliders and the king (castling aside): to has to be on the piece's
+// empty-board target set and, for sliders, nothing may stand in between
+bool checkLegalPiece(Move m, const S_BOARD *board) {
+    int from = FROMSQ(m), to = TOSQ(m);
+    int type = PIECE_TYPE(board->pieces[from]);
+    if (!(PseudoAttacks[type][from] & SQBB(to))) return false;
+    if (PieceSlides[type] && (BetweenBB[from][to] & occupiedBB(board))) return false;
 
-    // ensure destination is not occupied by own piece (already done in checkLegal)
-    // now simulate and test for check
-    int cap = board.pieces[m.to];
-    board.pieces[m.to]   = board.pieces[m.from];
-    board.pieces[m.from] = EMPTY;
-
-    bool ok = !isKingInCheck(board);
-
-    // restore
-    board.pieces[m.from] = board.pieces[m.to];
-    board.pieces[m.to]   = cap;
-    return ok;
+    return !leavesKingInCheck(m, board);
 }
 
-bool checkLegalRook(Move m, S_BOARD board) {
-    int delta = m.to - m.from, dir = 0;
-    for (int i = 0; i < 4; i++) {
-        if (delta % ROOK_DIRS[i] == 0 && delta / ROOK_DIRS[i] > 0) {
-            dir = ROOK_DIRS[i];
-            break;
-        }
-    }
-    if (!dir) return false;
-    if (!isPathClear(m.from, m.to, dir, board.pieces)) return false;
-
-    int cap = board.pieces[m.to];
-    board.pieces[m.to]   = board.pieces[m.from];
-    board.pieces[m.from] = EMPTY;
-
-    bool ok = !isKingInCheck(board);
-
-    board.pieces[m.from] = board.pieces[m.to];
-    board.pieces[m.to]   = cap;
-    return ok;
-}
-
-bool checkLegalQueen(Move m, S_BOARD board) {
-    if (checkLegalRook(m, board))   return true;
-    if (checkLegalBishop(m, board)) return true;
-    return false;
-}
-
-bool checkLegalKnight(Move m, S_BOARD board) {
-    // Find direction of the knight and check if it is a legal direction for the knight
-    bool valid = false;
-    for (int i = 0; i < 8; i++) {
-        if (m.to - m.from == KNIGHT_DIRS[i]) {
-            valid = true;
-            break;
-        }
-    }
-    if (!valid) return false;
-
-    int start = m.to;
-    if (board.pieces[start] == OFFBOARD) {
+bool checkLegalQueensideCastle(const S_BOARD *board) {
+    int back = board->side == WHITE ? 0 : A8;
+    if ((board->side == WHITE ? board->wCastle : board->bCastle) & QUEEN_SIDE) {
         return false;
     }
-    if ((board.pieces[start] > 0 && board.pieces[start] < 7 && board.side == WHITE) || (board.pieces[start] >= 7 && board.side == BLACK)) {
-        return false;
-    }
-
-    int captured_piece = board.pieces[m.to];
-    board.pieces[m.to] = board.pieces[m.from];
-    board.pieces[m.from] = EMPTY;
 
-    if (isKingInCheck(board)) {
+    if (board->pieces[A1 + back] != MAKE_PIECE(board->side, ROOK)) {
         return false;
     }
 
-    board.pieces[m.from] = board.pieces[m.to];
-    board.pieces[m.to] = captured_piece;
-
-    return true;
-}
-
-bool checkLegalKing(Move m, S_BOARD board) {
-    // Find direction of the knight and check if it is a legal direction for the king
-    bool valid = false;
-    for (int i = 0; i < 8; i++) {
-        if (m.to-m.from == KING_DIRS[i]) {
-            valid = true;
-            break;
-        }
-    }
-    if (!valid) return false;
-    int start = m.to;
-    if (board.pieces[start] == OFFBOARD) {
-        return false;
-    }
-    if ((board.pieces[start] > 0 && board.pieces[start] < bP && board.side == WHITE) || (board.pieces[start] >= bP && board.side == BLACK)) {
+    if (board->pieces[B1 + back] != EMPTY || board->pieces[C1 + back] != EMPTY || board->pieces[D1 + back] != EMPTY) {
         return false;
     }
 
-    int captured_piece = board.pieces[m.to];
-    board.pieces[m.to] = board.pieces[m.from];
-    board.pieces[m.from] = EMPTY;
-
-    if (isKingInCheck(board)) {
-        return false;
+    // The king may not castle out of, through or into check
+    int them = board->side ^ 1;
+    int path[3] = { E1 + back, D1 + back, C1 + back };
+    for (int i = 0; i < 3; i++) {
+        if (isSquareAttacked(path[i], them, board)) {
+            return false;
+        }
     }
 
-    board.pieces[m.from] = board.pieces[m.to];
-    board.pieces[m.to] = captured_piece;
-
     return true;
 }
 
-bool checkLegalQueensideCastle(S_BOARD board) {
-    if ((board.bCastle != 0 && board.side == BLACK) || (board.wCastle != 0 && board.side == WHITE)) {
+bool checkLegalKingsideCastle(const S_BOARD *board) {
+    int back = board->side == WHITE ? 0 : A8;
+    if ((board->side == WHITE ? board->wCastle : board->bCastle) & KING_SIDE) {
         return false;
     }
 
-    if ((board.pieces[A1] != wR && board.side == WHITE) || (board.pieces[A8] != bR && board.side == BLACK)) {
+    if (board->pieces[H1 + back] != MAKE_PIECE(board->side, ROOK)) {
         return false;
     }
 
-    if ((board.side == WHITE && (board.pieces[B1] != EMPTY || board.pieces[C1] != EMPTY || board.pieces[D1] != EMPTY)) 
-    || (board.side == BLACK && (board.pieces[B8] != EMPTY || board.pieces[C8] != EMPTY || board.pieces[D8] != EMPTY))) {
+    if (board->pieces[F1 + back] != EMPTY || board->pieces[G1 + back] != EMPTY) {
         return false;
     }
 
-    int piece = board.side == WHITE ? wK : bK;
-    board.pieces[board.side == WHITE ? E1 : E8] = EMPTY;
-    board.pieces[board.side == WHITE ? D1 : D8] = piece;
-
-    if (isKingInCheck(board)) {
-        return false;
-    }
-
-    board.pieces[board.side == WHITE ? C1 : C8] = piece;
-    board.pieces[board.side == WHITE ? D1 : D8] = board.side == WHITE ? wR : bR;
-
-    if (isKingInCheck(board)) {
-        return false;
+    // The king may not castle out of, through or into check
+    int them = board->side ^ 1;
+    int path[3] = { E1 + back, F1 + back, G1 + back };
+    for (int i = 0; i < 3; i++) {
+        if (isSquareAttacked(path[i], them, board)) {
+            return false;
+        }
     }
 
-    board.pieces[board.side == WHITE ? E1 : E8] = piece;
-    board.pieces[board.side == WHITE ? D1 : D8] = EMPTY;
-    board.pieces[board.side == WHITE ? C1 : C8] = EMPTY;
-    board.pieces[board.side == WHITE ? A1 : A8] = board.side == WHITE ? wR : bR;
-
     return true;
 }
 
-bool checkLegalKingsideCastle(S_BOARD board) {
-    if ((board.bCastle != 0 && board.side == BLACK) || (board.wCastle != 0 && board.side == WHITE)) {
-        return false;
+bool checkLegal(Move m, const S_BOARD *board) {
+    // Castle logic
+    if (FLAGS(m) == QUEEN_CASTLE) {
+        return checkLegalQueensideCastle(board);
     }
 
-    if ((board.pieces[H1] != wR && board.side == WHITE) || (board.pieces[H8] != bR && board.side == BLACK)) {
-        return false;
+    if (FLAGS(m) == KING_CASTLE) {
+        return checkLegalKingsideCastle(board);
     }
 
-    if ((board.side == WHITE && (board.pieces[F1] != EMPTY || board.pieces[G1] != EMPTY)) 
-    || (board.side == BLACK && (board.pieces[F8] != EMPTY || board.pieces[G8] != EMPTY))) {
+    // If move is out of bounds, then it is illegal
+    if (FROMSQ(m) == TOSQ(m) || board->pieces[FROMSQ(m)] == EMPTY) {
         return false;
     }
 
-    int piece = board.side == WHITE ? wK : bK;
-    board.pieces[board.side == WHITE ? E1 : E8] = EMPTY;
-    board.pieces[board.side == WHITE ? F1 : F8] = piece;
-
-    if (isKingInCheck(board)) {
+    // The moving piece has to be ours and the target square may not hold one of ours
+    U64 us = board->colorBB[board->side];
+    if (!(us & SQBB(FROMSQ(m))) || (us & SQBB(TOSQ(m)))) {
         return false;
     }
 
-    board.pieces[board.side == WHITE ? G1 : G8] = piece;
-    board.pieces[board.side == WHITE ? F1 : F8] = board.side == WHITE ? wR : bR;
-
-    if (isKingInCheck(board)) {
-        return false;
+    if (PIECE_TYPE(board->pieces[FROMSQ(m)]) == PAWN) {
+        return checkLegalPawn(m, board);
     }
-
-    board.pieces[board.side == WHITE ? E1 : E8] = piece;
-    board.pieces[board.side == WHITE ? F1 : F8] = EMPTY;
-    board.pieces[board.side == WHITE ? G1 : G8] = EMPTY;
-    board.pieces[board.side == WHITE ? H1 : H8] = board.side == WHITE ? wR : bR;
-
-    return true;
+    return checkLegalPiece(m, board);
 }
 
-bool checkLegal(Move m, S_BOARD board) {
-    // Castle logic
-    if (m.is_castle_queenside) {
-        return checkLegalQueensideCastle(board);
-    }
-
-    if (m.is_castle_kingside) {
-        return checkLegalKingsideCastle(board);
-    }
-
-    // If move is out of bounds, then it is illegal
-    if (m.to < 0 || m.to >= 120 || board.pieces[m.to] == OFFBOARD || m.from < 0 || m.from >= 120 || board.pieces[m.from] == OFFBOARD || board.pieces[m.from] == EMPTY) {
-        return false;
-    }
-
-    // If the turn does not match the piece that is moving, again it is illegal
-    if ((board.pieces[m.from] < 7 && board.side == BLACK) || (board.pieces[m.from] >= 7 && board.side == WHITE)) {
-        return false;
+// A move from or to sq gives up castling on the wings whose king or rook starts there
+static void updateCastling(S_BOARD *board, int sq) {
+    switch (sq) {
+        case E1: board->wCastle |= KING_SIDE | QUEEN_SIDE; break;
+        case H1: board->wCastle |= KING_SIDE; break;
+        case A1: board->wCastle |= QUEEN_SIDE; break;
+        case E8: board->bCastle |= KING_SIDE | QUEEN_SIDE; break;
+        case H8: board->bCastle |= KING_SIDE; break;
+        case A8: board->bCastle |= QUEEN_SIDE; break;
     }
+}
 
-    // If the turn does not match the piece that is moving, again it is illegal
-    if ((board.pieces[m.to] > 0 && board.pieces[m.to] < 7 && board.side == WHITE) || (board.pieces[m.to] >= 7 && board.side == BLACK)) {
-        return false;
+// Play m and push what takeMove needs to take it back onto board->history
+void makeMove(Move m, S_BOARD *board) {
+    int from = FROMSQ(m), to = TOSQ(m);
+    int back = board->side == WHITE ? 0 : A8;
+
+    ASSERT(board->hisPly < MAX_GAME_MOVES);
+    S_UNDO *undo = &board->history[board->hisPly++];
+    undo->posKey    = board->posKey;
+    undo->fiftyMove = board->fiftyMove;
+    undo->move      = m;
+    undo->captured  = board->pieces[to];
+    undo->enPas     = board->enPas;
+    undo->wCastle   = board->wCastle;
+    undo->bCastle   = board->bCastle;
+    board->ply++;
+
+    if (IS_CAPTURE(m) || PIECE_TYPE(board->pieces[from]) == PAWN) {
+        board->fiftyMove = 0;
+    } else {
+        board->fiftyMove++;
     }
 
-    char piece = PIECE_CHARS[board.pieces[m.from]];
+    // The pieces hash themselves as they move; en passant and castling keys are
+    // taken out here and the new ones put back at the end
+    if (board->enPas != NO_SQ) board->posKey ^= EnPasKeys[board->enPas];
+    board->posKey ^= CastleKeys[board->wCastle | board->bCastle << 2];
 
-    switch (piece) {
-    // Pawn Legality Checks
-        case 'P':  
-            return checkLegalPawn(m, board);
-            break;
-    // Bishop Legality Checks
-        case 'B':
-            return checkLegalBishop(m, board);
+    board->enPas = NO_SQ;
+    switch (FLAGS(m)) {
+        case KING_CASTLE:
+            movePiece(board, E1 + back, G1 + back);
+            movePiece(board, H1 + back, F1 + back);
             break;
-    // Knight Legality Checks
-        case 'N':
-            return checkLegalKnight(m, board);
+        case QUEEN_CASTLE:
+            movePiece(board, E1 + back, C1 + back);
+            movePiece(board, A1 + back, D1 + back);
             break;
-    // Rook Legality Checks
-        case 'R':  
-            return checkLegalRook(m, board);
+        case DOUBLE_PUSH:
+            movePiece(board, from, to);
+            board->enPas = (from + to) / 2;   // the square the pawn skipped
             break;
-    // Queen Legality Checks
-        case 'Q':
-            return checkLegalQueen(m, board);
-            break;
-    // King Legality Checks
-        case 'K':
-            return checkLegalKing(m, board);
+        case EP_CAPTURE:
+            movePiece(board, from, to);
+            clearPiece(board, board->side == WHITE ? to - 8 : to + 8);
             break;
         default:
-            return false;
+            clearPiece(board, to);
+            if (IS_PROMO(m)) {
+                clearPiece(board, from);
+                addPiece(board, to, PROMOTED(m, board->side));
+            } else {
+                movePiece(board, from, to);
+            }
             break;
     }
 
-    return false;
+    updateCastling(board, from);
+    updateCastling(board, to);
+    board->posKey ^= CastleKeys[board->wCastle | board->bCastle << 2];
+    if (board->enPas != NO_SQ) board->posKey ^= EnPasKeys[board->enPas];
+    board->posKey ^= SideKey;
+    board->side = board->side == WHITE ? BLACK : WHITE;
+    ASSERT(board->posKey == generatePosKey(board));
+}
+
+static inline void addMove(S_MOVELIST *list, Move move) {
+    list->moves[list->count].move  = move;
+    list->moves[list->count].score = 0;
+    list->count++;
 }
 
-void makeMove(Move m, S_BOARD *board) {
-    // TODO: Add make move functionality
-    // - Add special case for enpassant
-    // - Set enpas value, and adjust castle logic if king moves or castle happens
-
-    if (m.is_castle_kingside) {
-        (*board).pieces[board->side == WHITE ? E1 : E8] = EMPTY;
-        (*board).pieces[board->side == WHITE ? F1 : F8] = board->side == WHITE ? wR : bR;
-        (*board).pieces[board->side == WHITE ? G1 : G8] = board->side == WHITE ? wK : bK;
-        (*board).pieces[board->side == WHITE ? H1 : H8] = EMPTY;
-
-        if (board->side == WHITE) {
-            board->wCastle = 1;
-        } else {
-            board->bCastle = 1;
+static inline void addPawnMove(int from, int to, S_MOVELIST *list, bool isCapture) {
+    int flags = isCapture ? CAPTURE : QUIET;
+    if (SQBB(to) & (RANK_1_BB | RANK_8_BB)) {
+        int promotions[] = {PROMO_Q, PROMO_R, PROMO_B, PROMO_N};
+        for (int i = 0; i < 4; i++) {
+            addMove(list, MOVE(from, to, flags | promotions[i]));
         }
-
-        board->enPas = 0;
-        board->side = board->side == WHITE ? BLACK : WHITE;
-        return;
+    } else {
+        addMove(list, MOVE(from, to, flags));
     }
+}
 
-    if (m.is_castle_queenside) {
-        (*board).pieces[board->side == WHITE ? E1 : E8] = EMPTY;
-        (*board).pieces[board->side == WHITE ? D1 : D8] = board->side == WHITE ? wR : bR;
-        (*board).pieces[board->side == WHITE ? C1 : C8] = board->side == WHITE ? wK : bK;
-        (*board).pieces[board->side == WHITE ? A1 : A8] = EMPTY;
+// Add a move from 'from' to each square of targets
+static void addPieceMoves(const S_BOARD *board, int from, U64 targets, S_MOVELIST *list) {
+    while (targets) {
+        int to = popLSB(&targets);
+        addMove(list, MOVE(from, to, board->pieces[to] != EMPTY ? CAPTURE : QUIET));
+    }
+}
 
-        if (board->side == WHITE) {
-            board->wCastle = 1;
-        } else {
-            board->bCastle = 1;
+// Legal moves for side, which must be the side to move. Only the two wrappers
+// below call this, each with a constant side, so every colour test folds away
+FORCE_INLINE void generateMovesFor(const S_BOARD *board, S_MOVELIST *list, int type, const int side) {
+    list->count = 0;
+
+    // Piece sets of either side, indexed by piece type
+    int them_side  = side ^ 1;
+    const U64 *own = board->pieceBB + MAKE_PIECE(side, 0);
+    const U64 *opp = board->pieceBB + MAKE_PIECE(them_side, 0);
+    U64 us    = board->colorBB[side];
+    U64 them  = board->colorBB[them_side];
+    U64 occ   = us | them;
+    U64 empty = ~occ;
+    U64 genMask = (type & GEN_CAPTURES ? them : 0) | (type & GEN_QUIETS ? empty : 0);
+    U64 b;
+
+    int kingSq = board->kingSq[side];
+    U64 checkers = attackersTo(kingSq, occ, board) & them;
+
+    // Generate king moves: the target must stay safe once the king has left kingSq,
+    // so sliders see through the square it vacates
+    U64 kingTargets = KingAttacks[kingSq] & genMask;
+    while (kingTargets) {
+        int to = popLSB(&kingTargets);
+        if (!(attackersTo(to, occ ^ SQBB(kingSq), board) & them)) {
+            addPieceMoves(board, kingSq, SQBB(to), list);
         }
+    }
 
-        board->enPas = 0;
-        board->side = board->side == WHITE ? BLACK : WHITE;
+    // In double check only the king can move
+    if (checkers & (checkers - 1)) {
         return;
     }
 
-    char piece = PIECE_CHARS[(*board).pieces[m.from]];
-
-    if (piece == 'P' && ((m.to-m.from) == 20 || (m.to-m.from) == -20)) {   
-        (*board).pieces[m.to] = (*board).pieces[m.from];
-        (*board).pieces[m.from] = EMPTY;
+    // In single check every other move has to capture the checker or block it
+    U64 checkMask = checkers ? checkers | BetweenBB[kingSq][LSB(checkers)] : ~0ULL;
 
-        board->enPas = m.to;
-        board->side = board->side == WHITE ? BLACK : WHITE;
-        return;
+    // A pinned piece may only move along the line through its king and the pinner
+    U64 pinned = 0;
+    U64 snipers = (rookAttacks(kingSq, 0) & (opp[ROOK] | opp[QUEEN]))
+                | (bishopAttacks(kingSq, 0) & (opp[BISHOP] | opp[QUEEN]));
+    while (snipers) {
+        U64 blockers = BetweenBB[kingSq][popLSB(&snipers)] & occ;
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & us)) {
+            pinned |= blockers;
+        }
     }
 
-    // EnPassant Logic
-    if (piece == 'P' && (*board).pieces[m.to] == EMPTY) {
-        (*board).pieces[m.to] = (*board).pieces[m.from];
-        (*board).pieces[m.from] = EMPTY;
-        if (board->side == WHITE) {
-            (*board).pieces[m.from+((m.to-m.from)-10)] = EMPTY;
-        } else {
-            (*board).pieces[m.from+((m.to-m.from)+10)] = EMPTY;
+    // Generate castling moves if allowed: not out of, through or into check
+    int lost = side == WHITE ? board->wCastle : board->bCastle;
+    int back = side == WHITE ? 0 : A8;
+    if (!checkers && (type & GEN_QUIETS)) {
+        if (!(lost & KING_SIDE) && board->pieces[F1 + back] == EMPTY && board->pieces[G1 + back] == EMPTY
+            && !isSquareAttacked(F1 + back, them_side, board) && !isSquareAttacked(G1 + back, them_side, board)) {
+            addMove(list, MOVE(E1 + back, G1 + back, KING_CASTLE));
+        }
+        if (!(lost & QUEEN_SIDE) && board->pieces[B1 + back] == EMPTY && board->pieces[C1 + back] == EMPTY && board->pieces[D1 + back] == EMPTY
+            && !isSquareAttacked(D1 + back, them_side, board) && !isSquareAttacked(C1 + back, them_side, board)) {
+            addMove(list, MOVE(E1 + back, C1 + back, QUEEN_CASTLE));
         }
-        
-
-        board->enPas = 0;
-        board->side = board->side == WHITE ? BLACK : WHITE;
-        return;
     }
 
-    if (piece == 'P' && ((m.to >= A8 && m.to <= H8) || (m.to >= A1 && m.to <= H1))) {
-        (*board).pieces[m.to] = m.promotion;
-        (*board).pieces[m.from] = EMPTY;
-
-        board->enPas = 0;
-        board->side = board->side == WHITE ? BLACK : WHITE;
-        return;
+    // Generate pawn moves, a whole set of pawns per shift
+    U64 pawns = own[PAWN];
+    int up = side == WHITE ? 8 : -8;
+    U64 single = side == WHITE ? (pawns << 8) & empty : (pawns >> 8) & empty;
+    U64 dbl    = side == WHITE ? ((single & RANK_3_BB) << 8) & empty
+                                      : ((single & RANK_6_BB) >> 8) & empty;
+    b = single & checkMask & genMask;
+    while (b) {
+        int to = popLSB(&b);
+        int from = to - up;
+        if ((pinned & SQBB(from)) && !(LineBB[kingSq][from] & SQBB(to))) continue;
+        addPawnMove(from, to, list, false);
+    }
+    b = dbl & checkMask & genMask;
+    while (b) {
+        int to = popLSB(&b);
+        int from = to - 2 * up;
+        if ((pinned & SQBB(from)) && !(LineBB[kingSq][from] & SQBB(to))) continue;
+        addMove(list, MOVE(from, to, DOUBLE_PUSH));
+    }
+    b = pawns;
+    while (b) {
+        int from = popLSB(&b);
+        U64 captures = PawnAttacks[side][from] & them & checkMask & genMask;
+        if (pinned & SQBB(from)) captures &= LineBB[kingSq][from];
+        while (captures) {
+            addPawnMove(from, popLSB(&captures), list, true);
+        }
+    }
+    // En passant takes a pawn off a different square than the target, which can
+    // uncover the king along the rank, so these get the full legality test
+    if (board->enPas != NO_SQ && (type & GEN_CAPTURES)) {
+        b = PawnAttacks[them_side][board->enPas] & pawns;
+        while (b) {
+            Move m = MOVE(popLSB(&b), board->enPas, EP_CAPTURE);
+            if (!leavesKingInCheck(m, board)) addMove(list, m);
+        }
     }
 
-    
+    // Generate knight moves, a pinned knight never has a legal move
+    b = own[KNIGHT] & ~pinned;
+    while (b) {
+        int from = popLSB(&b);
+        addPieceMoves(board, from, KnightAttacks[from] & genMask & checkMask, list);
+    }
 
-    if (piece == 'K') {
-        if (board->side == WHITE) {
-            board->wCastle = 1;
-        } else {
-            board->bCastle = 1;
-        }
+    // Generate sliding moves (Bishop/Rook/Queen)
+    b = own[BISHOP] | own[ROOK] | own[QUEEN];
+    while (b) {
+        int from = popLSB(&b);
+        int type = PIECE_TYPE(board->pieces[from]);
+        U64 targets = type == BISHOP ? bishopAttacks(from, occ)
+                    : type == ROOK   ? rookAttacks(from, occ)
+                    : queenAttacks(from, occ);
+        targets &= genMask & checkMask;
+        if (pinned & SQBB(from)) targets &= LineBB[kingSq][from];
+        addPieceMoves(board, from, targets, list);
     }
+}
 
-    (*board).pieces[m.to] = (*board).pieces[m.from];
-    (*board).pieces[m.from] = EMPTY;
+static void generateWhiteMoves(const S_BOARD *board, S_MOVELIST *list, int type) {
+    generateMovesFor(board, list, type, WHITE);
+}
 
-    board->enPas = 0;
-    board->side = board->side == WHITE ? BLACK : WHITE;
+static void generateBlackMoves(const S_BOARD *board, S_MOVELIST *list, int type) {
+    generateMovesFor(board, list, type, BLACK);
 }
 
-void addPawnMove(S_BOARD *board, int from, int to, Move *moves, int *count, bool isCapture) {
-    int promoRank = (board->side == WHITE) ? 7 : 0; // Corrected promotion ranks
-    if ((to/10 - 2) == promoRank) {
-        int promotions[] = {(board->side == WHITE) ? wQ : bQ, 
-                           (board->side == WHITE) ? wR : bR,
-                           (board->side == WHITE) ? wB : bB,
-                           (board->side == WHITE) ? wN : bN};
-        for (int i = 0; i < 4; i++) {
-            Move m = {from, to, promotions[i], isCapture, false, false};
-            if (checkLegal(m, *board)) {
-                moves[(*count)++] = m;
-            }
-        }
+// Legal moves of the side to move; type picks captures, quiet moves or both
+void generateMoves(const S_BOARD *board, S_MOVELIST *list, int type) {
+    if (board->side == WHITE) {
+        generateWhiteMoves(board, list, type);
     } else {
-        Move m = {from, to, EMPTY, isCapture, false, false};
-        if (checkLegal(m, *board)) {
-            moves[(*count)++] = m;
-        }
+        generateBlackMoves(board, list, type);
     }
 }
 
-void generateLegalMoves(S_BOARD *board, Move *moves, int *moveCount) {
-    *moveCount = 0;
+void generateLegalMoves(const S_BOARD *board, S_MOVELIST *list) {
+    generateMoves(board, list, GEN_ALL);
+}
 
-    // Generate castling moves if allowed
-    if (board->side == WHITE && board->wCastle == 0) {
-        Move kingside = {E1, G1, EMPTY, false, true, false};
-        if (checkLegal(kingside, *board)) {
-            moves[(*moveCount)++] = kingside;
-        }
-        Move queenside = {E1, C1, EMPTY, false, false, true};
-        if (checkLegal(queenside, *board)) {
-            moves[(*moveCount)++] = queenside;
-        }
-    } else if (board->side == BLACK && board->bCastle == 0) {
-        Move kingside = {E8, G8, EMPTY, false, true, false};
-        if (checkLegal(kingside, *board)) {
-            moves[(*moveCount)++] = kingside;
-        }
-        Move queenside = {E8, C8, EMPTY, false, false, true};
-        if (checkLegal(queenside, *board)) {
-            moves[(*moveCount)++] = queenside;
-        }
+// Captures only, generated on their own for the quiescence search
+void generateCaptures(const S_BOARD *board, S_MOVELIST *list) {
+    generateMoves(board, list, GEN_CAPTURES);
+}
+
+// The hash move and killers were found in other positions, so they are only
+// tried when the board still matches their flags and checkLegal accepts them
+static bool moveFitsBoard(Move m, const S_BOARD *board) {
+    int from = FROMSQ(m), to = TOSQ(m), flags = FLAGS(m);
+    int piece = board->pieces[from];
+    bool pawn = PIECE_TYPE(piece) == PAWN;
+    bool occupied = board->pieces[to] != EMPTY;
+
+    if (flags == KING_CASTLE || flags == QUEEN_CASTLE) {
+        int back = board->side == WHITE ? 0 : A8;
+        if (m != MOVE(E1 + back, (flags == KING_CASTLE ? G1 : C1) + back, flags)) return false;
+        return checkLegal(m, board);
+    }
+    if (flags == 6 || flags == 7) return false;   // unused codes
+    if (flags == EP_CAPTURE ? (!pawn || occupied || (to - from) % 8 == 0) : IS_CAPTURE(m) != occupied) return false;
+    if ((flags == DOUBLE_PUSH) != (pawn && (to - from == 16 || to - from == -16))) return false;
+    if (IS_PROMO(m) != (pawn && (to / 8 == 0 || to / 8 == 7))) return false;
+    return checkLegal(m, board);
+}
+
+// Bring the best scored move at or after index in list to index and return it, a
+// selection sort step done only as far as the search actually gets
+static inline Move pickBest(S_MOVELIST *list, int index) {
+    int best = index;
+    for (int i = index + 1; i < list->count; i++) {
+        if (list->moves[i].score > list->moves[best].score) best = i;
+    }
+    S_MOVE tmp = list->moves[index];
+    list->moves[index] = list->moves[best];
+    list->moves[best] = tmp;
+    return list->moves[index].move;
+}
+
+// MVV-LVA: the most valuable victim first, and among equal victims the cheapest
+// attacker. Captures that lose material by SEE go behind all the others
+static void scoreCaptures(S_MOVELIST *list, const S_BOARD *board) {
+    for (int i = 0; i < list->count; i++) {
+        Move m = list->moves[i].move;
+        int victim = FLAGS(m) == EP_CAPTURE ? PAWN : PIECE_TYPE(board->pieces[TOSQ(m)]);
+        list->moves[i].score = victim * 8 - PIECE_TYPE(board->pieces[FROMSQ(m)]);
+        if (losingCapture(board, m)) list->moves[i].score -= 64;
     }
+}
 
-    // Generate moves for each piece
-    for (int from = 0; from < BOARD_SQ_NUM; from++) {
-        if (board->pieces[from] == OFFBOARD || board->pieces[from] == EMPTY)
-            continue;
-        if ((board->side == WHITE && board->pieces[from] >= bP) || 
-            (board->side == BLACK && board->pieces[from] <= wK))
-            continue;
+// Quiet moves by their history score, queen promotions ahead of all of them
+static void scoreQuiets(S_MOVELIST *list, const int (*history)[SQ_NUM]) {
+    for (int i = 0; i < list->count; i++) {
+        Move m = list->moves[i].move;
+        list->moves[i].score = FLAGS(m) == PROMO_Q ? HISTORY_MAX + 1 : history[FROMSQ(m)][TOSQ(m)];
+    }
+}
 
-        int p = board->pieces[from];
-        
-        // Generate pawn moves
-        if (p == wP || p == bP) {
-            int dir = (p == wP) ? 10 : -10;
-            int startRank = (p == wP) ? 1 : 6; // Corrected start ranks for double push
-            
-            // Single push
-            int to = from + dir;
-            if (board->pieces[to] == EMPTY) {
-                addPawnMove(board, from, to, moves, moveCount, false);
-                
-                // Double push from start rank
-                if (((from/10 - 2) == startRank) && board->pieces[to + dir] == EMPTY) {
-                    Move m = {from, to + dir, EMPTY, false, false, false};
-                    if (checkLegal(m, *board)) {
-                        moves[(*moveCount)++] = m;
-                    }
-                }
-            }
-            
-            // Captures (including en passant)
-            int targets[] = {from + dir + 1, from + dir - 1};
-            for (int i = 0; i < 2; i++) {
-                to = targets[i];
-                if (board->pieces[to] == OFFBOARD) continue;
-
-                bool isCapture = (board->pieces[to] != EMPTY) || (to == board->enPas);
-                if (isCapture) {
-                    addPawnMove(board, from, to, moves, moveCount, true);
-                }
-            }
-        }
-        // Generate knight moves
-        else if (p == wN || p == bN) {
-            for (int i = 0; i < 8; i++) {
-                int to = from + KNIGHT_DIRS[i];
-                if (board->pieces[to] == OFFBOARD) continue;
-                if (board->pieces[to] != EMPTY) {
-                    bool ownPiece = (board->side == WHITE) ? 
-                        (board->pieces[to] <= wK) : (board->pieces[to] >= bP);
-                    if (ownPiece) continue;
-                }
-                
+void initMovePicker(S_MOVEPICKER *mp, Move hashMove, const int (*history)[SQ_NUM]) {
+    mp->hashMove = hashMove;
+    mp->history = history;
+    mp->stage = STAGE_HASH;
+    mp->index = 0;
+}
 
-                Move m = {from, to, EMPTY, board->pieces[to] != EMPTY, false, false};
-                if (checkLegal(m, *board)) {
-                    moves[(*moveCount)++] = m;
-                }
+// Next move of the node or NOMOVE once all are out. Order: hash move, captures,
+// killers, other quiet moves. Each stage is generated only when reached, so a
+// cutoff on an early move skips the rest of the generation
+Move nextMove(S_MOVEPICKER *mp, const S_BOARD *board) {
+    switch (mp->stage) {
+        case STAGE_HASH:
+            mp->stage = STAGE_GEN_CAPTURES;
+            if (mp->hashMove != NOMOVE) {
+                if (moveFitsBoard(mp->hashMove, board)) return mp->hashMove;
+                mp->hashMove = NOMOVE;
             }
-        }
-        // Generate sliding moves (Bishop/Rook/Queen)
-        else if (p == wB || p == bB || p == wR || p == bR || p == wQ || p == bQ) {
-            int dirs[8], dirCount;
-            if (p == wB || p == bB) {
-                dirs[0] = 11; dirs[1] = 9; dirs[2] = -9; dirs[3] = -11;
-                dirCount = 4;
-            } else if (p == wR || p == bR) {
-                dirs[0] = 10; dirs[1] = 1; dirs[2] = -1; dirs[3] = -10;
-                dirCount = 4;
-            } else { // Queen
-                dirs[0] = 11; dirs[1] = 10; dirs[2] = 9; dirs[3] = 1; 
-                dirs[4] = -1; dirs[5] = -9; dirs[6] = -10; dirs[7] = -11;
-                dirCount = 8;
+            // fall through
+        case STAGE_GEN_CAPTURES:
+            generateMoves(board, &mp->list, GEN_CAPTURES);
+            scoreCaptures(&mp->list, board);
+            mp->index = 0;
+            mp->stage = STAGE_CAPTURES;
+            // fall through
+        case STAGE_CAPTURES:
+            while (mp->index < mp->list.count) {
+                Move m = pickBest(&mp->list, mp->index++);
+                if (m != mp->hashMove) return m;
             }
-            
-            for (int d = 0; d < dirCount; d++) {
-                int to = from;
-                while (1) {
-                    to += dirs[d];
-                    if (board->pieces[to] == OFFBOARD) break;
-
-                    if (board->pieces[to] != EMPTY) {
-                        bool ownPiece = (board->side == WHITE) ? 
-                            (board->pieces[to] <= wK) : (board->pieces[to] >= bP);
-                        if (ownPiece) break;
-                    }
-
-                    Move m = {from, to, EMPTY, board->pieces[to] != EMPTY, false, false};
-                    if (checkLegal(m, *board)) {
-                        moves[(*moveCount)++] = m;
-                    }
-
-                    if (board->pieces[to] != EMPTY) break; // Stop after capturing
-                }
+            mp->killers[0] = board->searchKillers[0][board->ply];
+            mp->killers[1] = board->searchKillers[1][board->ply];
+            mp->index = 0;
+            mp->stage = STAGE_KILLERS;
+            // fall through
+        case STAGE_KILLERS:
+            // A killer that is not played here is cleared so the quiet stage does not skip it
+            while (mp->index < 2) {
+                Move k = mp->killers[mp->index++];
+                if (k != NOMOVE && k != mp->hashMove && !IS_CAPTURE(k) && moveFitsBoard(k, board)) return k;
+                mp->killers[mp->index - 1] = NOMOVE;
             }
-        }
-        // Generate king moves
-        else if (p == wK || p == bK) {
-            for (int i = 0; i < 8; i++) {
-                int to = from + KING_DIRS[i];
-                if (board->pieces[to] == OFFBOARD) continue;
-
-                if (board->pieces[to] != EMPTY) {
-                    bool ownPiece = (board->side == WHITE) ? 
-                        (board->pieces[to] <= wK) : (board->pieces[to] >= bP);
-                    if (ownPiece) continue;
-                }
-                
-                Move m = {from, to, EMPTY, board->pieces[to] != EMPTY, false, false};
-                if (checkLegal(m, *board)) {
-                    moves[(*moveCount)++] = m;
-                }
+            mp->stage = STAGE_GEN_QUIETS;
+            // fall through
+        case STAGE_GEN_QUIETS:
+            generateMoves(board, &mp->list, GEN_QUIETS);
+            scoreQuiets(&mp->list, mp->history);
+            mp->index = 0;
+            mp->stage = STAGE_QUIETS;
+            // fall through
+        case STAGE_QUIETS:
+            while (mp->index < mp->list.count) {
+                Move m = pickBest(&mp->list, mp->index++);
+                if (m != mp->hashMove && m != mp->killers[0] && m != mp->killers[1]) return m;
             }
-        }
+            mp->stage = STAGE_DONE;
+            // fall through
+        default:
+            return NOMOVE;
     }
 }
 
-void generateCaptures(S_BOARD *board, Move *moves, int *moveCount) {
-    Move allLegalMoves[256];
-    int legalMoveCount = 0;
-
-    generateLegalMoves(board, allLegalMoves, &legalMoveCount);
-
-    for (int i = 0; i < legalMoveCount; i++) {
-        if (allLegalMoves[i].is_capture) {
-            moves[(*moveCount)++] = allLegalMoves[i];
+// Pseudo-legal mobility: squares reached by every piece of side, plus pawn pushes
+static int mobility(const S_BOARD *board, int side) {
+    U64 us  = board->colorBB[side];
+    U64 occ = occupiedBB(board);
+    int count = 0;
+    for (int i = 0; i < board->pieceCount[side]; i++) {
+        int sq = board->pieceList[side][i];
+        switch (PIECE_TYPE(board->pieces[sq])) {
+            case PAWN:   count += POPCOUNT(SQBB(sq + PawnPush[side]) & ~occ); break;
+            case KNIGHT: count += POPCOUNT(KnightAttacks[sq] & ~us); break;
+            case BISHOP: count += POPCOUNT(bishopAttacks(sq, occ) & ~us); break;
+            case ROOK:   count += POPCOUNT(rookAttacks(sq, occ) & ~us); break;
+            case QUEEN:  count += POPCOUNT(queenAttacks(sq, occ) & ~us); break;
+            case KING:   count += POPCOUNT(KingAttacks[sq] & ~us); break;
         }
     }
+    return count;
 }
 
-double Evaluate(S_BOARD board) {
+double Evaluate(const S_BOARD *board) {
     double score = 0;
-    for (int i = A1; i < H8; i++) {
-        if (board.pieces[i] == EMPTY || board.pieces[i] == OFFBOARD) {
-            continue;
-        }
-        int mult = board.pieces[i] < bP ? 1 : -1;
-        switch (PIECE_CHARS[board.pieces[i]]) {
-            case 'P':  
-                score+= 1*mult;
-                score+= mult*0.09*PawnEval[board.side == WHITE ? 0 : 1][i];
-                break;
-            case 'B':
-                score+= 3.1*mult;
-                break;
-            case 'N':
-                score+= 3*mult;
-                break;
-            case 'R':  
-                score+= 5*mult;
-                break;
-            case 'Q':
-                score+= 9*mult;
-                break;
-            default:
-                break;
+    for (int side = WHITE; side <= BLACK; side++) {
+        int mult = side == WHITE ? 1 : -1;
+        for (int i = 0; i < board->pieceCount[side]; i++) {
+            int sq = board->pieceList[side][i];
+            int type = PIECE_TYPE(board->pieces[sq]);
+            score+= mult*PieceValue[type];
+            if (type == PAWN) {
+                score+= mult*0.09*PawnEval[board->side == WHITE ? 0 : 1][sq];
+            }
         }
     }
-    Move legalMoves[256];
-    int moveCount = 0;
-    generateLegalMoves(&board, legalMoves, &moveCount);
-    board.side = board.side == WHITE ? BLACK : WHITE;
 
-    int moveCount2 = 0;
-    generateLegalMoves(&board, legalMoves, &moveCount2);
-    board.side = board.side == WHITE ? BLACK : WHITE;
+    int moveCount = mobility(board, board->side);
+    int moveCount2 = mobility(board, board->side == WHITE ? BLACK : WHITE);
+    if (moveCount + moveCount2 > 0) {
+        score += (board->side == WHITE ? 1 : -1)*((moveCount-moveCount2)/(moveCount2+moveCount)) * 4;
+    }
+    return score*(board->side==WHITE ? 1 : -1);
+}
+
+// Take back the last move made on b, popping its record off b->history
+static void takeMove(S_BOARD *b) {
+    const S_UNDO *undo = &b->history[--b->hisPly];
+    Move m = undo->move;
+    int from = FROMSQ(m), to = TOSQ(m);
+    // side has not been flipped back yet, so the mover is the other one
+    int mover = b->side == WHITE ? BLACK : WHITE;
+    int back = mover == WHITE ? 0 : A8;
+
+    switch (FLAGS(m)) {
+        case KING_CASTLE:
+            movePiece(b, G1 + back, E1 + back);
+            movePiece(b, F1 + back, H1 + back);
+            break;
+        case QUEEN_CASTLE:
+            movePiece(b, C1 + back, E1 + back);
+            movePiece(b, D1 + back, A1 + back);
+            break;
+        case EP_CAPTURE:
+            movePiece(b, to, from);
+            addPiece(b, to - PawnPush[mover], MAKE_PIECE(mover ^ 1, PAWN));
+            break;
+        default:
+            if (IS_PROMO(m)) {
+                clearPiece(b, to);
+                addPiece(b, from, MAKE_PIECE(mover, PAWN));
+            } else {
+                movePiece(b, to, from);
+            }
+            // restore whatever was on 'to' (could be EMPTY or a captured piece)
+            if (undo->captured != EMPTY) addPiece(b, to, undo->captured);
+            break;
+    }
 
-    score += (board.side == WHITE ? 1 : -1)*((moveCount-moveCount2)/(moveCount2+moveCount)) * 4;
-    return score*(board.side==WHITE ? 1 : -1);
+    // restore state fields
+    b->enPas     = undo->enPas;
+    b->wCastle   = undo->wCastle;
+    b->bCastle   = undo->bCastle;
+    b->fiftyMove = undo->fiftyMove;
+    b->side      = mover;
+    b->posKey    = undo->posKey;
+    b->ply--;
+    ASSERT(b->posKey == generatePosKey(b));
 }
 
-static StateInfo makeMoveUndoable(Move m, S_BOARD *b) {
-    StateInfo st = {
-      .captured   = b->pieces[m.to],
-      .ep_old     = b->enPas,
-      .wCast_old  = b->wCastle,
-      .bCast_old  = b->bCastle
-    };
-    makeMove(m, b);
-    return st;
+// Pass the turn: only the side and the en passant square change
+static void makeNullMove(S_BOARD *b) {
+    ASSERT(b->hisPly < MAX_GAME_MOVES);
+    S_UNDO *undo = &b->history[b->hisPly++];
+    undo->posKey    = b->posKey;
+    undo->fiftyMove = b->fiftyMove;
+    undo->move      = NOMOVE;
+    undo->enPas     = b->enPas;
+    b->ply++;
+    b->fiftyMove++;
+    if (b->enPas != NO_SQ) b->posKey ^= EnPasKeys[b->enPas];
+    b->enPas = NO_SQ;
+    b->posKey ^= SideKey;
+    b->side ^= 1;
+    ASSERT(b->posKey == generatePosKey(b));
 }
 
-static void undoMove(StateInfo st, Move m, S_BOARD *b) {
-    // --- handle castling undo ---
-    if (m.is_castle_kingside) {
-        // King went E1→G1 (or E8→G8), rook went H1→F1 (or H8→F8)
-        if (m.from == E1) {
-            // White
-            b->pieces[E1] = wK;
-            b->pieces[G1] = EMPTY;
-            b->pieces[H1] = wR;
-            b->pieces[F1] = EMPTY;
-        } else {
-            // Black
-            b->pieces[E8] = bK;
-            b->pieces[G8] = EMPTY;
-            b->pieces[H8] = bR;
-            b->pieces[F8] = EMPTY;
-        }
-    }
-    else if (m.is_castle_queenside) {
-        // King went E1→C1 (or E8→C8), rook went A1→D1 (or A8→D8)
-        if (m.from == E1) {
-            // White
-            b->pieces[E1] = wK;
-            b->pieces[C1] = EMPTY;
-            b->pieces[A1] = wR;
-            b->pieces[D1] = EMPTY;
-        } else {
-            // Black
-            b->pieces[E8] = bK;
-            b->pieces[C8] = EMPTY;
-            b->pieces[A8] = bR;
-            b->pieces[D8] = EMPTY;
-        }
-    } else if (m.promotion != EMPTY) {
-        int pawnPiece = (m.promotion < bP ? wP : bP);
-        b->pieces[m.from] = pawnPiece;
-        // restore whatever was on 'to' (could be EMPTY or a captured piece)
-        b->pieces[m.to]   = st.captured;
-    }
-    // --- all other moves (including promotions & captures) ---
-    else {
-        b->pieces[m.from] = b->pieces[m.to];
-        b->pieces[m.to]   = st.captured;
-    }
+static void takeNullMove(S_BOARD *b) {
+    const S_UNDO *undo = &b->history[--b->hisPly];
+    b->enPas     = undo->enPas;
+    b->fiftyMove = undo->fiftyMove;
+    b->posKey    = undo->posKey;
+    b->side ^= 1;
+    b->ply--;
+    ASSERT(b->posKey == generatePosKey(b));
+}
 
-    // restore state fields
-    b->enPas   = st.ep_old;
-    b->wCastle = st.wCast_old;
-    b->bCastle = st.bCast_old;
-    // flip side back
-    b->side    = (b->side == WHITE ? BLACK : WHITE);
+// Play a move in the game. Game moves are never taken back, so once the undo stack
+// runs short of room for a search below this position, the records already played are dropped
+static void makeGameMove(Move m, S_BOARD *b) {
+    if (b->hisPly >= MAX_GAME_MOVES - 2 * MAX_DEPTH) b->hisPly = 0;
+    makeMove(m, b);
 }
 
-void orderMoves(Move (*moves)[256], int moveCount, S_BOARD board) {
-    for(int i=1;i<moveCount;i++){
-        if ((*moves)[i].is_capture && !(*moves)[i-1].is_capture) {
-          Move tmp = (*moves)[i];
-          (*moves)[i] = (*moves)[i-1];
-          (*moves)[i-1] = tmp;
-        }
+long long getTimeMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// Budget for one move from the clock: time left and increment in ms and the moves
+// to the next time control (0 for sudden death). Untimed, only depth limits the
+// search. A clock that has run out, or gone negative after an overrun, gets the
+// smallest budget; depth 1 is finished regardless. An iteration takes a few times
+// the one before, so none is started past half the budget; the hard stop allows up to three times it
+static void setSearchLimits(S_SEARCHINFO *info, bool timed, long long timeLeft, long long inc, int movesToGo, int depth) {
+    info->startTime = getTimeMs();
+    info->softStop = info->hardStop = info->startTime;
+    info->depth = depth < MAX_DEPTH ? depth : MAX_DEPTH - 1;
+    info->timed = timed;
+    if (timed) {
+        if (timeLeft < 0) timeLeft = 0;
+        long long safe = timeLeft - MOVE_OVERHEAD_MS > 1 ? timeLeft - MOVE_OVERHEAD_MS : 1;
+        long long budget = timeLeft / (movesToGo > 0 ? movesToGo : 30) + inc * 3 / 4;
+        if (budget > safe) budget = safe;
+        if (budget < 1) budget = 1;
+        info->softStop = info->startTime + budget / 2;
+        info->hardStop = info->startTime + (budget * 3 < safe ? budget * 3 : safe);
     }
 }
 
-double Quies(double alpha, double beta, S_BOARD* board) {
-    int val = Evaluate(*board);
+// Polled every 2048 nodes, so the clock is read rarely but the stop is still prompt.
+// Never before depth 1 is done, so there is always a move to play
+static inline void checkTime(S_SEARCHINFO *info) {
+    if (info->timed && info->completed && getTimeMs() >= info->hardStop) info->stopped = true;
+}
+
+double Quies(double alpha, double beta, S_BOARD* board, S_SEARCHINFO *info) {
+    if ((++info->nodes & 2047) == 0) checkTime(info);
+    double val = Evaluate(board);
     if (val >= beta)
         return beta;
     if (val > alpha)
         alpha = val;
-    Move legalMoves[256];
-    int moveCount = 0;
-    generateCaptures(board, legalMoves, &moveCount);
-    for (int i = 0; i < moveCount; i++) {
-        StateInfo st = makeMoveUndoable(legalMoves[i], board);
-        double val = -Quies(-beta, -alpha, board);
-        undoMove(st, legalMoves[i], board);
-        if (val >= beta)
+
+    Move ttMove;
+    double ttScore;
+    if (probeTT(board->posKey, 0, board->ply, alpha, beta, &ttMove, &ttScore))
+        return ttScore;
+
+    S_MOVELIST list;
+    generateCaptures(board, &list);
+    // MVV-LVA order, with the stored capture first
+    scoreCaptures(&list, board);
+    for (int i = 0; i < list.count; i++) {
+        if (list.moves[i].move == ttMove) list.moves[i].score = INT_MAX;
+    }
+    double oldAlpha = alpha;
+    Move bestMove = NOMOVE;
+    for (int i = 0; i < list.count; i++) {
+        Move move = pickBest(&list, i);
+        // Captures that lose material come last and cannot raise the stand-pat score
+        if (list.moves[i].score < 0) break;
+        makeMove(move, board);
+        double val = -Quies(-beta, -alpha, board, info);
+        takeMove(board);
+        if (info->stopped) return 0;
+        if (val >= beta) {
+            storeTT(board->posKey, 0, board->ply, beta, BOUND_LOWER, move);
             return beta;
-        if (val > alpha)
+        }
+        if (val > alpha) {
             alpha = val;
+            bestMove = move;
+        }
     }
+    storeTT(board->posKey, 0, board->ply, alpha, alpha > oldAlpha ? BOUND_EXACT : BOUND_UPPER, bestMove);
     return alpha;
 }
 
-double AlphaBetaSearch(int depth, double alpha, double beta, S_BOARD* board, bool isRoot) {
+// Remember a quiet move that caused a cutoff, newest in slot 0
+static void storeKiller(S_BOARD *board, Move move) {
+    if (board->searchKillers[0][board->ply] != move) {
+        board->searchKillers[1][board->ply] = board->searchKillers[0][board->ply];
+        board->searchKillers[0][board->ply] = move;
+    }
+}
+
+// Credit a quiet move that caused a cutoff, deeper cutoffs more. Once an entry passes
+// HISTORY_MAX the whole table is halved, so old results fade
+static void updateHistory(S_SEARCHINFO *info, int side, Move move, int depth) {
+    int *entry = &info->history[side][FROMSQ(move)][TOSQ(move)];
+    *entry += depth * depth;
+    if (*entry > HISTORY_MAX) {
+        int *h = &info->history[0][0][0];
+        for (size_t i = 0; i < sizeof(info->history) / sizeof(int); i++) {
+            h[i] /= 2;
+        }
+    }
+}
+
+// Late move reductions by remaining depth and move number, about
+// 0.75 + ln(depth) * ln(number) / 2.25 plies as in most engines
+static uint8_t LMRTable[MAX_DEPTH][MAX_MOVES];
+
+static void initLMR(void) {
+    for (int d = 1; d < MAX_DEPTH; d++) {
+        for (int m = 1; m < MAX_MOVES; m++) {
+            // log2 in 1/256ths, linear between powers of two; ln * ln / 2.25 = log2 * log2 * 0.2136
+            int ld = MSB((U64)d) * 256 + ((d - (1 << MSB((U64)d))) << 8 >> MSB((U64)d));
+            int lm = MSB((U64)m) * 256 + ((m - (1 << MSB((U64)m))) << 8 >> MSB((U64)m));
+            LMRTable[d][m] = (49152 + ld * lm * 7 / 32) >> 16;
+        }
+    }
+}
+
+double AlphaBetaSearch(int depth, double alpha, double beta, S_BOARD* board, S_SEARCHINFO *info, bool isRoot, bool doNull) {
+    if (isRoot) board->ply = 0;
+    if ((++info->nodes & 2047) == 0) checkTime(info);
+    if (board->ply >= MAX_DEPTH - 1)
+        return Evaluate(board);
+    // Check extension: a side in check has few replies, so look one ply further
+    bool inCheck = isKingInCheck(board);
+    if (inCheck && !isRoot) depth++;
     if (depth == 0)
-        return Quies(alpha, beta, board);
-    Move legalMoves[256];
-    int moveCount = 0;
-    generateLegalMoves(board, legalMoves, &moveCount);
-    orderMoves(&legalMoves, moveCount, *board);
+        return Quies(alpha, beta, board, info);
+
+    // A deep enough stored result settles the node, except at the root where the move is
+    // wanted and in a singular test, which searches the position without one of its moves
+    Move excluded = board->searchExcluded[board->ply];
+    Move ttMove;
+    double ttScore;
+    if (probeTT(board->posKey, depth, board->ply, alpha, beta, &ttMove, &ttScore) && !isRoot && excluded == NOMOVE) {
+        return ttScore;
+    }
+    // The excluded move is the hash move; dropping it also keeps singular tests from nesting
+    if (excluded != NOMOVE) ttMove = NOMOVE;
+
+    // Pruning on the static score: only in null-window nodes away from check, where
+    // a wrong guess costs a re-search higher up and not the principal variation. A
+    // null window is rebuilt by negation every ply, so its width is only SCORE_EPS
+    // up to rounding
+    bool pruneNode = !isRoot && !inCheck && beta - alpha < 2 * SCORE_EPS;
+    double staticEval = pruneNode ? Evaluate(board) : 0;
+
+    // Reverse futility: so far above beta that no reply at this depth is expected to bring it back
+    if (pruneNode && depth <= RFP_DEPTH && staticEval - RFP_MARGIN * depth >= beta) {
+        return beta;
+    }
 
-    for (int i = 0; i < moveCount; i++) {
-        StateInfo st = makeMoveUndoable(legalMoves[i], board);
-        double val = -AlphaBetaSearch(depth - 1, -beta, -alpha, board, false);
-        undoMove(st, legalMoves[i], board);
+    // Razoring: so far below alpha that only a capture could help, so let quiescence decide
+    if (pruneNode && depth <= RAZOR_DEPTH && staticEval + RAZOR_MARGIN * depth <= alpha) {
+        double val = Quies(alpha, beta, board, info);
+        if (info->stopped) return 0;
+        if (val <= alpha) return alpha;
+    }
+
+    // Null move: if passing the turn still holds beta, some real move will too. Not
+    // in check, not twice in a row, and not with only pawns, where zugzwang makes
+    // passing better than any move. Deep cutoffs are confirmed by a reduced search
+    // of the real moves, so a zugzwang the material test misses cannot cut a big tree
+    if (doNull && !isRoot && excluded == NOMOVE && depth >= 3 && !inCheck
+        && (board->colorBB[board->side] & ~board->pieceBB[MAKE_PIECE(board->side, PAWN)]
+                                        & ~board->pieceBB[MAKE_PIECE(board->side, KING)])) {
+        int R = depth > 6 ? 3 : 2;
+        makeNullMove(board);
+        double val = -AlphaBetaSearch(depth - 1 - R, -beta, -beta + SCORE_EPS, board, info, false, false);
+        takeNullMove(board);
+        if (info->stopped) return 0;
+        if (val >= beta) {
+            if (depth < NULL_VERIFY_DEPTH) return beta;
+            val = AlphaBetaSearch(depth - R, beta - SCORE_EPS, beta, board, info, false, false);
+            if (info->stopped) return 0;
+            if (val >= beta) return beta;
+        }
+    }
+
+    // ProbCut: a good capture that holds a raised beta even in a much shallower search
+    // would almost surely hold beta in the full one, so the node is cut on its word.
+    // Quiescence screens each capture first, which is cheap and fails most of them.
+    // Near mate scores beta plus a margin means nothing, so ProbCut stays out there
+    if (pruneNode && excluded == NOMOVE && depth >= PROBCUT_DEPTH && beta < MATE_SCORE - MAX_DEPTH) {
+        double probBeta = beta + PROBCUT_MARGIN;
+        S_MOVELIST list;
+        generateCaptures(board, &list);
+        scoreCaptures(&list, board);
+        for (int i = 0; i < list.count; i++) {
+            Move move = pickBest(&list, i);
+            if (list.moves[i].score < 0) break;
+            makeMove(move, board);
+            double val = -Quies(-probBeta, -probBeta + SCORE_EPS, board, info);
+            if (val >= probBeta && !info->stopped) {
+                val = -AlphaBetaSearch(depth - PROBCUT_REDUCTION, -probBeta, -probBeta + SCORE_EPS, board, info, false, true);
+            }
+            takeMove(board);
+            if (info->stopped) return 0;
+            if (val >= probBeta) {
+                storeTT(board->posKey, depth - PROBCUT_REDUCTION + 1, board->ply, beta, BOUND_LOWER, move);
+                return beta;
+            }
+        }
+    }
+
+    // Singular extension: when every other move falls clearly short of the stored score
+    // of the hash move in a reduced search, the hash move alone holds the position and
+    // is searched a ply deeper
+    int singularExt = 0;
+    const S_TTENTRY *tte = ttMove != NOMOVE && !isRoot && depth >= SINGULAR_DEPTH ? findTT(board->posKey) : NULL;
+    if (tte && (tte->genBound & 3) != BOUND_UPPER && tte->depth >= depth - 3) {
+        double singularBeta = scoreFromTT(tte->score, board->ply) - SINGULAR_MARGIN * depth;
+        board->searchExcluded[board->ply] = ttMove;
+        double val = AlphaBetaSearch((depth - 1) / 2, singularBeta - SCORE_EPS, singularBeta, board, info, false, false);
+        board->searchExcluded[board->ply] = NOMOVE;
+        if (info->stopped) return 0;
+        if (val < singularBeta) singularExt = 1;
+    }
+
+    S_MOVEPICKER mp;
+    initMovePicker(&mp, ttMove, info->history[board->side]);
+
+    double oldAlpha = alpha;
+    Move bestMove = NOMOVE;
+    Move move;
+    int searched = 0;
+    // Futility: near the leaves, quiet moves cannot lift a score this far below alpha
+    bool futile = pruneNode && depth <= FUTILITY_DEPTH && staticEval + FUTILITY_MARGIN * depth <= alpha;
+    while ((move = nextMove(&mp, board)) != NOMOVE) {
+        if (move == excluded) continue;
+        int newDepth = depth - 1 + (move == ttMove ? singularExt : 0);
+        // A later capture that loses material by SEE is first tried a ply shallower
+        int reduction = searched > 0 && depth >= 3 && IS_CAPTURE(move) && losingCapture(board, move) ? 1 : 0;
+        makeMove(move, board);
+        if (futile && searched > 0 && !IS_CAPTURE(move) && !IS_PROMO(move) && !isKingInCheck(board)) {
+            takeMove(board);
+            continue;
+        }
+        // Quiet moves after the hash move and killers are searched shallower the later
+        // they come, unless either side is in check; the full depth is the re-search
+        if (searched >= LMR_MIN_MOVES && depth >= 3 && !inCheck && !IS_CAPTURE(move) && !IS_PROMO(move)
+            && move != mp.killers[0] && move != mp.killers[1] && !isKingInCheck(board)) {
+            reduction = LMRTable[depth < MAX_DEPTH ? depth : MAX_DEPTH - 1][searched];
+            if (reduction > depth - 2) reduction = depth - 2;
+        }
+        double val;
+        if (searched++ == 0) {
+            val = -AlphaBetaSearch(newDepth, -beta, -alpha, board, info, false, true);
+        } else {
+            // PVS: a later move only has to be shown no better than alpha, which a null
+            // window does cheaply; one that beats it is searched again with the real window
+            val = -AlphaBetaSearch(newDepth - reduction, -alpha - SCORE_EPS, -alpha, board, info, false, true);
+            if (val > alpha && reduction && !info->stopped) {
+                val = -AlphaBetaSearch(newDepth, -alpha - SCORE_EPS, -alpha, board, info, false, true);
+            }
+            if (val > alpha && val < beta && !info->stopped) {
+                val = -AlphaBetaSearch(newDepth, -beta, -alpha, board, info, false, true);
+            }
+        }
+        takeMove(board);
+        // An abandoned search leaves nothing worth keeping
+        if (info->stopped) return 0;
 
         if (val >= beta) {
+            if (isRoot) board->bestMove = move;
+            if (!IS_CAPTURE(move)) {
+                storeKiller(board, move);
+                updateHistory(info, board->side, move, depth);
+            }
+            if (excluded == NOMOVE) storeTT(board->posKey, depth, board->ply, beta, BOUND_LOWER, move);
             return beta;
         }
         if (val > alpha) {
             alpha = val;
-            if (isRoot) board->bestMove = legalMoves[i];
+            bestMove = move;
+            if (isRoot) board->bestMove = move;
         }
     }
+    // No legal move: checkmate, or stalemate. Futility skips nothing before the
+    // first move, so searched is 0 only here. A nearer mate scores further from zero
+    if (searched == 0 && excluded == NOMOVE) {
+        double score = inCheck ? -MATE_SCORE + board->ply : 0;
+        return score <= alpha ? alpha : score >= beta ? beta : score;
+    }
+    if (excluded == NOMOVE) {
+        storeTT(board->posKey, depth, board->ply, alpha, alpha > oldAlpha ? BOUND_EXACT : BOUND_UPPER, bestMove);
+    }
     return alpha;
 }
 
-bool isKingCheckmated(S_BOARD board) {
-    Move legalMoves[256];
-    int moveCount = 0;
-    generateLegalMoves(&board, legalMoves, &moveCount);
-    return moveCount == 0;
+// Iterative deepening: search depth 1, 2, ... within info's limits and return the
+// best move of the last iteration that finished, also left in board->bestMove
+Move searchPosition(S_BOARD *board, S_SEARCHINFO *info) {
+    Move best = NOMOVE;
+    double scores[MAX_DEPTH];
+    info->nodes = 0;
+    info->completed = 0;
+    info->stopped = false;
+    newSearchTT();
+    memset(board->searchKillers, 0, sizeof(board->searchKillers));
+    memset(board->searchExcluded, 0, sizeof(board->searchExcluded));
+    memset(info->history, 0, sizeof(info->history));
+    for (int depth = 1; depth <= info->depth; depth++) {
+        // Aspiration: expect about the score of two iterations back, whose leaves have
+        // the same side to move (Evaluate swings a lot between odd and even depths).
+        // A failing side is widened, and opened fully once past a few pawns
+        double delta = ASPIRATION_WINDOW;
+        double alpha = depth > 2 ? scores[depth - 2] - delta : -INF_SCORE;
+        double beta  = depth > 2 ? scores[depth - 2] + delta : INF_SCORE;
+        double score;
+        while (true) {
+            board->bestMove = NOMOVE;
+            score = AlphaBetaSearch(depth, alpha, beta, board, info, true, true);
+            if (info->stopped) break;
+            delta *= 2;
+            // A side already open cannot fail again, so only a bounded one is widened
+            if (score <= alpha && alpha > -INF_SCORE) {
+                alpha = delta > ASPIRATION_MAX ? -INF_SCORE : alpha - delta;
+            } else if (score >= beta && beta < INF_SCORE) {
+                beta = delta > ASPIRATION_MAX ? INF_SCORE : beta + delta;
+            } else {
+                break;
+            }
+        }
+        if (info->stopped) break;
+        scores[depth] = score;
+        best = board->bestMove;
+        info->completed = depth;
+        if (info->timed && getTimeMs() >= info->softStop) break;
+    }
+    board->bestMove = best;
+    return best;
+}
+
+bool isKingCheckmated(const S_BOARD *board) {
+    S_MOVELIST list;
+    generateLegalMoves(board, &list);
+    return list.count == 0;
 }
 
 
@@ -1014,14 +1146,14 @@ static bool init_sdl(void) {
 
 // Load all piece textures
 static bool load_textures(void) {
-    const char* files[13] = {
-        "",
-        "sprites/wP.png","sprites/wN.png","sprites/wB.png",
-        "sprites/wR.png","sprites/wQ.png","sprites/wK.png",
-        "sprites/bP.png","sprites/bN.png","sprites/bB.png",
-        "sprites/bR.png","sprites/bQ.png","sprites/bK.png"
+    const char* files[PIECE_NB] = {
+        [wP] = "sprites/wP.png", [wN] = "sprites/wN.png", [wB] = "sprites/wB.png",
+        [wR] = "sprites/wR.png", [wQ] = "sprites/wQ.png", [wK] = "sprites/wK.png",
+        [bP] = "sprites/bP.png", [bN] = "sprites/bN.png", [bB] = "sprites/bB.png",
+        [bR] = "sprites/bR.png", [bQ] = "sprites/bQ.png", [bK] = "sprites/bK.png"
     };
-    for (int i = 1; i <= 12; i++) {
+    for (int i = 0; i < PIECE_NB; i++) {
+        if (!files[i]) continue;   // codes that are no piece
         SDL_Surface *surf = IMG_Load(files[i]);
         if (!surf) {
             SDL_Log("IMG_Load %s failed: %s", files[i], IMG_GetError());
@@ -1039,27 +1171,24 @@ static bool load_textures(void) {
 
 // Cleanup SDL resources
 static void cleanup(void) {
-    for (int i = 1; i <= 12; i++) if (textures[i]) SDL_DestroyTexture(textures[i]);
+    for (int i = 0; i < PIECE_NB; i++) if (textures[i]) SDL_DestroyTexture(textures[i]);
     if (renderer) SDL_DestroyRenderer(renderer);
     if (window)   SDL_DestroyWindow(window);
     IMG_Quit();
     SDL_Quit();
 }
 
-// Convert 120-index to GUI row,col
-static bool sq120_to_rc(int sq, int *row, int *col) {
-    int r = (sq / 10) - 2;
-    int c = (sq % 10) - 1;
-    if (r < 0 || r > 7 || c < 0 || c > 7) return false;
-    *row = 7 - r;
-    *col = c;
+// Convert square index to GUI row,col
+static bool sq_to_rc(int sq, int *row, int *col) {
+    if (sq < 0 || sq >= SQ_NUM) return false;
+    *row = 7 - sq / 8;
+    *col = sq % 8;
     return true;
 }
 
-// Convert GUI row,col to 120-index
-static int rc_to_sq120(int row, int col) {
-    int r = 7 - row;
-    return (r + 2) * 10 + (col + 1);
+// Convert GUI row,col to square index
+static int rc_to_sq(int row, int col) {
+    return (7 - row) * 8 + col;
 }
 
 // Render board, highlights, and pieces
@@ -1084,20 +1213,20 @@ static void render_board(void) {
     // Highlight legal moves (blue)
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
     SDL_SetRenderDrawColor(renderer, 0, 0, 255, 100);
-    for (int i = 0; i < selCount; i++) {
-        Move m = selMoves[i];
+    for (int i = 0; i < selMoves.count; i++) {
+        Move m = selMoves.moves[i].move;
         int rr, cc;
         // King/capture target
-        if (sq120_to_rc(m.to, &rr, &cc)) {
+        if (sq_to_rc(TOSQ(m), &rr, &cc)) {
             SDL_Rect hl = { cc * SQUARE_SIZE, rr * SQUARE_SIZE, SQUARE_SIZE, SQUARE_SIZE };
             SDL_RenderFillRect(renderer, &hl);
         }
         // Rook landing square if castling
-        if (m.is_castle_kingside || m.is_castle_queenside) {
-            int rookTo = m.is_castle_kingside
+        if (FLAGS(m) == KING_CASTLE || FLAGS(m) == QUEEN_CASTLE) {
+            int rookTo = FLAGS(m) == KING_CASTLE
                 ? (board.side == WHITE ? F1 : F8)
                 : (board.side == WHITE ? D1 : D8);
-            if (sq120_to_rc(rookTo, &rr, &cc)) {
+            if (sq_to_rc(rookTo, &rr, &cc)) {
                 SDL_Rect hl2 = { cc * SQUARE_SIZE, rr * SQUARE_SIZE, SQUARE_SIZE, SQUARE_SIZE };
                 SDL_RenderFillRect(renderer, &hl2);
             }
@@ -1108,7 +1237,7 @@ static void render_board(void) {
     // Highlight selected square (green)
     if (selectedFrom != NO_SQ) {
         int sr, sc;
-        if (sq120_to_rc(selectedFrom, &sr, &sc)) {
+        if (sq_to_rc(selectedFrom, &sr, &sc)) {
             SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
             SDL_SetRenderDrawColor(renderer, 0, 255, 0, 100);
             SDL_Rect hl = { sc * SQUARE_SIZE, sr * SQUARE_SIZE, SQUARE_SIZE, SQUARE_SIZE };
@@ -1118,11 +1247,11 @@ static void render_board(void) {
     }
 
     // Draw pieces
-    for (int sq = 0; sq < BOARD_SQ_NUM; sq++) {
+    for (int sq = 0; sq < SQ_NUM; sq++) {
         int p = board.pieces[sq];
-        if (p > EMPTY && p <= bK) {
+        if (p != EMPTY) {
             int rr, cc;
-            if (!sq120_to_rc(sq, &rr, &cc)) continue;
+            if (!sq_to_rc(sq, &rr, &cc)) continue;
             SDL_Rect dst = { cc * SQUARE_SIZE, rr * SQUARE_SIZE, SQUARE_SIZE, SQUARE_SIZE };
             SDL_RenderCopy(renderer, textures[p], NULL, &dst);
         }
@@ -1131,10 +1260,26 @@ static void render_board(void) {
     SDL_RenderPresent(renderer);
 }
 
-// Map mouse x,y to 120-index
+// Map mouse x,y to square index
 static int square_from_mouse(int x, int y) {
     if (x < 0 || x >= WINDOW_SIZE || y < 0 || y >= WINDOW_SIZE) return NO_SQ;
-    return rc_to_sq120(y / SQUARE_SIZE, x / SQUARE_SIZE);
+    return rc_to_sq(y / SQUARE_SIZE, x / SQUARE_SIZE);
+}
+
+// Set up the starting position with a full engine clock and an empty hash
+static void newGame(void) {
+    board.side      = WHITE;
+    board.enPas     = NO_SQ;
+    board.wCastle   = board.bCastle = 0;
+    board.ply       = 0;
+    board.hisPly    = 0;
+    board.fiftyMove = 0;
+    initBoard(&board.pieces);
+    rebuildBoard(&board);
+    selectedFrom = NO_SQ;
+    selMoves.count = 0;
+    engineClock = ENGINE_CLOCK_MS;
+    clearTT();
 }
 
 int main(void) {
@@ -1144,26 +1289,34 @@ int main(void) {
     }
 
     // Initialize board state
-    board.side      = WHITE;
-    board.enPas     = 0;
-    board.wCastle   = board.bCastle = 0;
-    initBoard(&board.pieces);
+    initBitboards();
+    initLMR();
+    initHashKeys();
+    if (!initTT(TT_DEFAULT_MB)) {
+        SDL_Log("Could not allocate the transposition table");
+        cleanup();
+        return 1;
+    }
+    newGame();
 
     bool quit = false;
     SDL_Event e;
-    Move allMoves[256];
-    int allCount;
+    S_MOVELIST allMoves;
 
     while (!quit) {
         while (SDL_PollEvent(&e)) {
             if (e.type == SDL_QUIT) {
                 quit = true;
             }
+            else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_n) {
+                // N starts a new game
+                newGame();
+            }
             else if (e.type == SDL_MOUSEBUTTONDOWN) {
                 if (e.button.button == SDL_BUTTON_RIGHT) {
                     // Cancel selection
                     selectedFrom = NO_SQ;
-                    selCount     = 0;
+                    selMoves.count = 0;
                 } else {
                     int sq = square_from_mouse(e.button.x, e.button.y);
                     if (sq == NO_SQ) break;
@@ -1173,21 +1326,19 @@ int main(void) {
                     // --- White’s human move ---
                     if (selectedFrom == NO_SQ) {
                         int pc = board.pieces[sq];
-                        bool myPiece = (pc != EMPTY && pc != OFFBOARD) &&
-                                       ((board.side == WHITE && pc < bP) ||
-                                        (board.side == BLACK && pc >= bP));
+                        bool myPiece = pc != EMPTY && PIECE_COLOR(pc) == board.side;
                         if (myPiece) {
                             selectedFrom = sq;
-                            selCount = 0;
-                            generateLegalMoves(&board, allMoves, &allCount);
-                            for (int i = 0; i < allCount; i++)
-                                if (allMoves[i].from == selectedFrom)
-                                    selMoves[selCount++] = allMoves[i];
+                            selMoves.count = 0;
+                            generateLegalMoves(&board, &allMoves);
+                            for (int i = 0; i < allMoves.count; i++)
+                                if (FROMSQ(allMoves.moves[i].move) == selectedFrom)
+                                    selMoves.moves[selMoves.count++] = allMoves.moves[i];
                         }
                     } else {
-                        for (int i = 0; i < selCount; i++) {
-                            if (selMoves[i].to == sq) {
-                                makeMove(selMoves[i], &board);
+                        for (int i = 0; i < selMoves.count; i++) {
+                            if (TOSQ(selMoves.moves[i].move) == sq) {
+                                makeGameMove(selMoves.moves[i].move, &board);
                                 moved = true;
                                 break;
                             }
@@ -1195,19 +1346,17 @@ int main(void) {
                         // re‑select if clicked another own piece
                         if (!moved) {
                             int pc = board.pieces[sq];
-                            bool myPiece = (pc != EMPTY && pc != OFFBOARD) &&
-                                           ((board.side == WHITE && pc < bP) ||
-                                            (board.side == BLACK && pc >= bP));
+                            bool myPiece = pc != EMPTY && PIECE_COLOR(pc) == board.side;
                             if (myPiece) {
                                 selectedFrom = sq;
-                                selCount = 0;
-                                generateLegalMoves(&board, allMoves, &allCount);
-                                for (int i = 0; i < allCount; i++)
-                                    if (allMoves[i].from == selectedFrom)
-                                        selMoves[selCount++] = allMoves[i];
+                                selMoves.count = 0;
+                                generateLegalMoves(&board, &allMoves);
+                                for (int i = 0; i < allMoves.count; i++)
+                                    if (FROMSQ(allMoves.moves[i].move) == selectedFrom)
+                                        selMoves.moves[selMoves.count++] = allMoves.moves[i];
                             } else {
                                 selectedFrom = NO_SQ;
-                                selCount     = 0;
+                                selMoves.count = 0;
                             }
                         }
                     }
@@ -1216,27 +1365,23 @@ int main(void) {
                     // --- Black’s engine reply ---
                     if (moved && board.side == BLACK) {
                         // First, collect all legal replies:
-                        Move legalAI[256];
-                        int  legalCountAI = 0;
-                        generateLegalMoves(&board, legalAI, &legalCountAI);
+                        S_MOVELIST legalAI;
+                        generateLegalMoves(&board, &legalAI);
 
-                        if (legalCountAI > 0) {
+                        if (legalAI.count > 0) {
                             // Seed rand() once at startup
-                            AlphaBetaSearch(2, -10.0, 10.0, &board, true);
+                            S_SEARCHINFO info;
+                            setSearchLimits(&info, true, engineClock, ENGINE_INC_MS, 0, MAX_DEPTH);
+                            searchPosition(&board, &info);
+                            engineClock += ENGINE_INC_MS - (getTimeMs() - info.startTime);
 
                             // Grab what the search thought was best:
                             Move ai = board.bestMove;
 
                             // Sanity‐check it against the list of generated moves:
                             bool valid = false;
-                            for (int i = 0; i < legalCountAI; i++) {
-                                if (legalAI[i].from      == ai.from      &&
-                                    legalAI[i].to        == ai.to        &&
-                                    legalAI[i].promotion == ai.promotion &&
-                                    legalAI[i].is_castle_kingside ==
-                                                            ai.is_castle_kingside &&
-                                    legalAI[i].is_castle_queenside ==
-                                                            ai.is_castle_queenside) {
+                            for (int i = 0; i < legalAI.count; i++) {
+                                if (legalAI.moves[i].move == ai) {
                                     valid = true;
                                     break;
                                 }
@@ -1244,17 +1389,17 @@ int main(void) {
 
                             // If it wasn’t valid, fall back to a random legal move:
                             if (!valid) {
-                                ai = legalAI[rand() % legalCountAI];
+                                ai = legalAI.moves[rand() % legalAI.count].move;
                             }
 
                             // Finally, execute it
-                            makeMove(ai, &board);
+                            makeGameMove(ai, &board);
                         }
                     }
 
                     if (moved) {
                         selectedFrom = NO_SQ;
-                        selCount     = 0;
+                        selMoves.count = 0;
                     }
                 }
             }
@@ -0,0 +1,51 @@
+#ifndef HASHKEYS_H
+#define HASHKEYS_H
+
+#include "defs.h"
+
+// xorshift64* generator, fixed seeds keep the magic search and the keys deterministic
+static U64 magicRand(U64 *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 2685821657736338717ULL;
+}
+
+// Zobrist keys: a position's key is the XOR of the keys of everything in it
+static U64 PieceKeys[PIECE_NB][64];
+static U64 SideKey;
+static U64 CastleKeys[16];      // indexed by wCastle | bCastle << 2
+static U64 EnPasKeys[64];
+
+static void initHashKeys(void) {
+    U64 seed = 1070372;
+    for (int piece = wP; piece <= bK; piece++) {
+        for (int sq = 0; sq < 64; sq++) {
+            PieceKeys[piece][sq] = magicRand(&seed);
+        }
+    }
+    SideKey = magicRand(&seed);
+    for (int i = 0; i < 16; i++) {
+        CastleKeys[i] = magicRand(&seed);
+    }
+    for (int sq = 0; sq < 64; sq++) {
+        EnPasKeys[sq] = magicRand(&seed);
+    }
+}
+
+// Key of board computed from scratch
+static U64 generatePosKey(const S_BOARD *board) {
+    U64 key = 0;
+    for (int side = WHITE; side <= BLACK; side++) {
+        for (int i = 0; i < board->pieceCount[side]; i++) {
+            int sq = board->pieceList[side][i];
+            key ^= PieceKeys[board->pieces[sq]][sq];
+        }
+    }
+    if (board->side == BLACK) key ^= SideKey;
+    if (board->enPas != NO_SQ) key ^= EnPasKeys[board->enPas];
+    key ^= CastleKeys[board->wCastle | board->bCastle << 2];
+    return key;
+}
+
+#endif
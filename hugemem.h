@@ -0,0 +1,84 @@
+#ifndef HUGEMEM_H
+#define HUGEMEM_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Memory for the big hash tables: mapped straight from the kernel so it can sit
+// on huge pages (fewer TLB misses), and cleared by several threads at once
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static int cpuCount(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// size rounded up to whole huge pages, as allocHuge maps and freeHuge unmaps it
+static size_t hugeSize(size_t size) {
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+// Zeroed memory of at least size bytes, or NULL. Tries reserved huge pages
+// first, then ordinary pages with a hint to back them by transparent huge pages
+static void *allocHuge(size_t size) {
+    size = hugeSize(size);
+    void *mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (mem == MAP_FAILED) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    }
+    return mem;
+}
+
+static void freeHuge(void *mem, size_t size) {
+    if (mem) munmap(mem, hugeSize(size));
+}
+
+typedef struct {
+    char  *start;
+    size_t len;
+    int    threaded;   // nonzero when a worker thread is clearing it
+} S_CLEARJOB;
+
+static void *clearWorker(void *arg) {
+    S_CLEARJOB *job = arg;
+    memset(job->start, 0, job->len);
+    return NULL;
+}
+
+// Zero size bytes at mem, split over threads. Run on fresh memory it also
+// faults the pages in on all cores instead of during the first search
+static void clearHuge(void *mem, size_t size, int threads) {
+    if (!mem) return;
+    if (threads < 1) threads = 1;
+    size_t chunk = hugeSize((size + threads - 1) / threads);
+    pthread_t workers[threads];
+    S_CLEARJOB jobs[threads];
+    int started = 0;
+    for (size_t offset = 0; offset < size && started < threads; offset += chunk, started++) {
+        jobs[started].start = (char *)mem + offset;
+        jobs[started].len = size - offset < chunk ? size - offset : chunk;
+        jobs[started].threaded = pthread_create(&workers[started], NULL, clearWorker, &jobs[started]) == 0;
+        // No thread to be had: clear the chunk here instead
+        if (!jobs[started].threaded) clearWorker(&jobs[started]);
+    }
+    for (int t = 0; t < started; t++) {
+        if (jobs[t].threaded) pthread_join(workers[t], NULL);
+    }
+}
+
+#endif
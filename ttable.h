@@ -0,0 +1,153 @@
+#ifndef TTABLE_H
+#define TTABLE_H
+
+#include "defs.h"
+#include "hugemem.h"
+
+#define TT_DEFAULT_MB 64
+#define TT_BUCKET     4
+
+// What a stored score says about the true one
+enum { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+// One search result, 16 bytes; the key check uses the half of posKey the index does not
+typedef struct {
+    double   score;
+    uint32_t key;
+    Move     move;
+    uint8_t  depth;
+    uint8_t  genBound;    // search generation << 2 | bound
+} S_TTENTRY;
+
+// Entries sharing an index, one cache line
+typedef struct {
+    S_TTENTRY entry[TT_BUCKET];
+} S_TTBUCKET;
+
+typedef struct {
+    S_TTBUCKET *buckets;
+    size_t bytes;
+    U64 mask;
+    uint8_t generation;   // bumped once per search, 6 bits are kept
+} S_TTABLE;
+
+static S_TTABLE TT = { NULL, 0, 0, 0 };
+
+// (Re)allocate the table at the largest power-of-two bucket count within mb
+// megabytes, e.g. when the hash size changes while running. Old entries are lost;
+// if the new table cannot be had, the old one is kept and false is returned
+static bool initTT(int mb) {
+    if (mb <= 0) return false;
+    U64 count = 1;
+    while (count * 2 * sizeof(S_TTBUCKET) <= (U64)mb << 20) count *= 2;
+    size_t bytes = count * sizeof(S_TTBUCKET);
+    S_TTBUCKET *buckets = allocHuge(bytes);
+    if (!buckets) return false;
+    freeHuge(TT.buckets, TT.bytes);
+    TT.buckets = buckets;
+    TT.bytes = bytes;
+    TT.mask = count - 1;
+    TT.generation = 0;
+    clearHuge(TT.buckets, TT.bytes, cpuCount());
+    return true;
+}
+
+// Forget every entry, e.g. between games
+static void clearTT(void) {
+    clearHuge(TT.buckets, TT.bytes, cpuCount());
+    TT.generation = 0;
+}
+
+// Start a new search, so the entries of older ones age
+static void newSearchTT(void) {
+    TT.generation = (TT.generation + 1) & 63;
+}
+
+// Mate scores count plies from the root, but the same position can be reached at
+// another ply. In the table they count from the entry's own position instead
+static inline bool isMateTT(double score) {
+    return (score > MATE_SCORE - 2 * MAX_DEPTH && score <= MATE_SCORE)
+        || (score < -MATE_SCORE + 2 * MAX_DEPTH && score >= -MATE_SCORE);
+}
+
+static inline double scoreToTT(double score, int ply) {
+    return !isMateTT(score) ? score : score > 0 ? score + ply : score - ply;
+}
+
+// A stored score as seen from ply plies below the root
+static inline double scoreFromTT(double score, int ply) {
+    return !isMateTT(score) ? score : score > 0 ? score - ply : score + ply;
+}
+
+static inline S_TTBUCKET *bucketTT(U64 key) {
+    return &TT.buckets[key & TT.mask];
+}
+
+// The entry stored for key, or NULL
+static const S_TTENTRY *findTT(U64 key) {
+    if (!TT.buckets) return NULL;
+    S_TTBUCKET *b = bucketTT(key);
+    for (int i = 0; i < TT_BUCKET; i++) {
+        S_TTENTRY *e = &b->entry[i];
+        if (e->key == (uint32_t)(key >> 32) && (e->genBound & 3) != BOUND_NONE) return e;
+    }
+    return NULL;
+}
+
+// Look key up at ply plies below the root. The stored move, if any, goes to *move;
+// returns true with the score to use in *score when the entry is deep enough to settle [alpha, beta]
+static bool probeTT(U64 key, int depth, int ply, double alpha, double beta, Move *move, double *score) {
+    const S_TTENTRY *e = findTT(key);
+    *move = e ? e->move : NOMOVE;
+    if (!e || e->depth < depth) return false;
+    double s = scoreFromTT(e->score, ply);
+    switch (e->genBound & 3) {
+        case BOUND_UPPER:
+            if (s > alpha) return false;
+            *score = alpha;
+            return true;
+        case BOUND_LOWER:
+            if (s < beta) return false;
+            *score = beta;
+            return true;
+        default:
+            *score = s <= alpha ? alpha : s >= beta ? beta : s;
+            return true;
+    }
+}
+
+// Store a result found ply plies below the root. A slot already holding key is
+// reused, but only by a result at least as deep, and at the same depth an exact
+// score is kept over a bound, so quiescence does not wipe out full searches of the
+// same position. Otherwise the entry worth least goes, where every search an entry
+// has aged costs it 8 plies of depth
+static void storeTT(U64 key, int depth, int ply, double score, int bound, Move move) {
+    if (!TT.buckets) return;
+    S_TTBUCKET *b = bucketTT(key);
+    uint32_t check = (uint32_t)(key >> 32);
+    S_TTENTRY *replace = &b->entry[0];
+    int worst = 1 << 30;
+    for (int i = 0; i < TT_BUCKET; i++) {
+        S_TTENTRY *e = &b->entry[i];
+        if (e->key == check) {
+            if (depth < e->depth) return;
+            if (depth == e->depth && bound != BOUND_EXACT && (e->genBound & 3) == BOUND_EXACT) return;
+            replace = e;
+            break;
+        }
+        int age = (TT.generation - (e->genBound >> 2)) & 63;
+        int worth = e->depth - 8 * age;
+        if (worth < worst) {
+            worst = worth;
+            replace = e;
+        }
+    }
+    // Keep the old move when this result has none, e.g. after failing low
+    if (move != NOMOVE || replace->key != check) replace->move = move;
+    replace->key      = check;
+    replace->score    = scoreToTT(score, ply);
+    replace->depth    = depth;
+    replace->genBound = TT.generation << 2 | bound;
+}
+
+#endif